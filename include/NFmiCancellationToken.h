@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+
+/*
+ * Cancellation token for database calls. A token is given to a connection
+ * with CancellationToken(), after which Cancel() from any thread interrupts
+ * the call that is running on the connection and makes further calls fail
+ * until the token is removed.
+ *
+ * A token can also carry a deadline, in which case the remaining time is used
+ * as statement/call timeout for each call made while the token is set.
+ */
+
+class NFmiCancellationToken
+{
+   public:
+	NFmiCancellationToken();
+	explicit NFmiCancellationToken(std::chrono::steady_clock::duration theTimeout);
+
+	NFmiCancellationToken(const NFmiCancellationToken&) = delete;
+	NFmiCancellationToken& operator=(const NFmiCancellationToken&) = delete;
+
+	void Cancel();
+
+	// True if Cancel() has been called or deadline has passed
+	bool Cancelled() const;
+
+	// Milliseconds left until deadline, -1 if there is no deadline
+	int Remaining() const;
+
+	// Used by the database classes to get notified on Cancel()
+	size_t Register(std::function<void()> theCallback);
+	void Unregister(size_t theId);
+
+   private:
+	std::atomic<bool> itsCancelled;
+	bool itsHasDeadline;
+	std::chrono::steady_clock::time_point itsDeadline;
+
+	std::mutex itsMutex;
+	size_t itsNextId;
+	std::map<size_t, std::function<void()>> itsCallbacks;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*
+ * Histogram of durations with fixed bucket bounds. Bounds are in
+ * milliseconds, a value is counted to the first bucket whose upper
+ * bound is not exceeded; the last bucket has no upper bound.
+ */
+
+class NFmiDBPoolHistogram
+{
+   public:
+	NFmiDBPoolHistogram();
+
+	void Add(std::chrono::steady_clock::duration theDuration);
+
+	static const std::vector<double>& Bounds();
+	const std::vector<unsigned long>& Counts() const
+	{
+		return itsCounts;
+	}
+	unsigned long Count() const
+	{
+		return itsCount;
+	}
+
+	double Mean() const;
+	double Max() const
+	{
+		return itsMax;
+	}
+
+	// Upper bound of the bucket that contains the given quantile (0..1)
+	double Quantile(double theQuantile) const;
+
+	std::string ToString() const;
+
+   private:
+	std::vector<unsigned long> itsCounts;
+	unsigned long itsCount;
+	double itsSum;
+	double itsMax;
+};
+
+/*
+ * Connection pool telemetry. Counters are cumulative since the pool was
+ * created or ResetStatistics() was called, except current which is the
+ * number of connections leased at the time the snapshot was taken.
+ */
+
+struct NFmiDBPoolStatistics
+{
+	NFmiDBPoolStatistics();
+
+	NFmiDBPoolHistogram waitTime;          // time spent in GetConnection()
+	NFmiDBPoolHistogram priorityWaitTime;  // time spent in GetConnection() by high priority callers
+	NFmiDBPoolHistogram holdTime;          // time from GetConnection() to Release()
+	NFmiDBPoolHistogram connectTime;       // time to open a new database connection
+
+	int maxWorkers;
+	int current;               // connections leased now
+	int peak;                  // maximum number of simultaneously leased connections
+	unsigned long leases;      // number of completed GetConnection() calls
+	unsigned long exhausted;   // GetConnection() calls that had to wait for a release
+	unsigned long sticky;      // leases that returned the worker the thread used last
+	unsigned long reconnects;  // connections that were lost and had to be opened again
+
+	std::string ToString() const;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+/*
+ * Static index of closed-open intervals [start, end) for point queries.
+ *
+ * Find(t) returns the values whose interval contains t, with the semantics
+ * of SQL (start, end) OVERLAPS (t, t): start <= t < end, or t == start for
+ * an interval where start == end. Start and end are swapped if given in
+ * reverse order.
+ *
+ * Overlapping(start, end) returns the values whose interval, taken as closed,
+ * overlaps the closed range [start, end].
+ *
+ * Intervals are kept sorted by start together with the running maximum of
+ * end, so a query is a binary search followed by a backward scan that stops
+ * as soon as no earlier interval can reach t.
+ */
+
+template <typename Key, typename Value>
+class NFmiIntervalIndex
+{
+   public:
+	void Insert(Key theStart, Key theEnd, const Value& theValue)
+	{
+		if (theEnd < theStart)
+		{
+			std::swap(theStart, theEnd);
+		}
+
+		itsIntervals.push_back(Interval{theStart, theEnd, theValue});
+		itsSorted = false;
+	}
+
+	void Clear()
+	{
+		itsIntervals.clear();
+		itsMaxEnd.clear();
+		itsSorted = true;
+	}
+
+	size_t Size() const
+	{
+		return itsIntervals.size();
+	}
+
+	std::vector<Value> Find(const Key& theTime)
+	{
+		Sort();
+
+		std::vector<Value> ret;
+
+		// First interval starting after theTime
+
+		auto it = std::upper_bound(itsIntervals.begin(), itsIntervals.end(), theTime,
+		                           [](const Key& t, const Interval& i) { return t < i.start; });
+
+		for (size_t i = it - itsIntervals.begin(); i-- > 0;)
+		{
+			if (itsMaxEnd[i] < theTime)
+			{
+				break;
+			}
+
+			const Interval& interval = itsIntervals[i];
+
+			if (theTime < interval.end || (interval.start == interval.end && interval.start == theTime))
+			{
+				ret.push_back(interval.value);
+			}
+		}
+
+		std::reverse(ret.begin(), ret.end());
+
+		return ret;
+	}
+
+	std::vector<Value> Overlapping(const Key& theStart, const Key& theEnd)
+	{
+		Sort();
+
+		std::vector<Value> ret;
+
+		// First interval starting after theEnd
+
+		auto it = std::upper_bound(itsIntervals.begin(), itsIntervals.end(), theEnd,
+		                           [](const Key& t, const Interval& i) { return t < i.start; });
+
+		for (size_t i = it - itsIntervals.begin(); i-- > 0;)
+		{
+			if (itsMaxEnd[i] < theStart)
+			{
+				break;
+			}
+
+			if (!(itsIntervals[i].end < theStart))
+			{
+				ret.push_back(itsIntervals[i].value);
+			}
+		}
+
+		std::reverse(ret.begin(), ret.end());
+
+		return ret;
+	}
+
+   private:
+	struct Interval
+	{
+		Key start;
+		Key end;
+		Value value;
+	};
+
+	void Sort()
+	{
+		if (itsSorted)
+		{
+			return;
+		}
+
+		std::stable_sort(itsIntervals.begin(), itsIntervals.end(),
+		                 [](const Interval& a, const Interval& b) { return a.start < b.start; });
+
+		itsMaxEnd.resize(itsIntervals.size());
+
+		for (size_t i = 0; i < itsIntervals.size(); i++)
+		{
+			itsMaxEnd[i] = (i == 0) ? itsIntervals[i].end : std::max(itsMaxEnd[i - 1], itsIntervals[i].end);
+		}
+
+		itsSorted = true;
+	}
+
+	std::vector<Interval> itsIntervals;
+	std::vector<Key> itsMaxEnd;
+	bool itsSorted = true;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Recent position history of moving stations (for example ice buoys).
+ *
+ * Samples are added in any order with their creation time as
+ * YYYYMMDDHH24MISS (UTC). The newest creation time seen is kept as a
+ * watermark so that the owner can fetch only newer samples on refresh.
+ */
+
+class NFmiMovingStationTracks
+{
+   public:
+	struct Position
+	{
+		time_t time;
+		double latitude;
+		double longitude;
+		std::string elevation;
+	};
+
+	// A sample added with theWatermark false (for example an old sample read
+	// individually) does not advance the watermark
+
+	void Add(unsigned long theStation, const std::string& theName, const std::string& theCreated, double theLatitude,
+	         double theLongitude, const std::string& theElevation, bool theWatermark = true);
+
+	// Latest position of a station, false if there is none
+	bool Latest(unsigned long theStation, Position& thePosition) const;
+
+	// Position at theTime, interpolated linearly between the samples around it.
+	// Outside of the track the first or last sample is returned.
+	bool At(unsigned long theStation, time_t theTime, Position& thePosition) const;
+
+	std::string Name(unsigned long theStation) const;
+
+	// Drop samples older than theOldest, keeping the latest sample of each station
+	void Prune(time_t theOldest);
+
+	// Creation time of the newest sample, empty if there are none
+	const std::string& Watermark() const
+	{
+		return itsWatermark;
+	}
+	bool Empty() const
+	{
+		return itsTracks.empty();
+	}
+
+	static time_t ToTime(const std::string& theTime);
+
+   private:
+	std::map<unsigned long, std::vector<Position>> itsTracks;  // sorted by time
+	std::map<unsigned long, std::string> itsNames;
+	std::string itsWatermark;
+};
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "NFmiDBPoolStatistics.h"
+#include "NFmiIntervalIndex.h"
 #include "NFmiOracle.h"
+#include "NFmiStationIndex.h"
 
 #include <map>
 #include <mutex>
@@ -52,8 +55,26 @@ class NFmiNeonsDB : public NFmiOracle
 	                                                                        double max_longitude, double min_longitude,
 	                                                                        bool temp = false);
 
+	/*
+	 * When enabled, GetStationListForArea() is answered from a spatial index
+	 * over all stations, read from database on first use, instead of a query
+	 * per bounding box. Results are the same, including their ordering.
+	 */
+
+	void StationIndex(bool theStationIndex) { itsStationIndex = theStationIndex; }
+	bool StationIndex() const { return itsStationIndex; }
+
+	/*
+	 * Observation tables of a producer with data between start_time and
+	 * end_time. The tables of a producer are read once and answered from
+	 * memory. They are read again when end_time is past the latest max_dat,
+	 * and every NeonsTablesRefresh() seconds (default 60).
+	 */
+
 	std::vector<std::string> GetNeonsTables(const std::string& start_time, const std::string& end_time,
 	                                        const std::string& producer_name);
+	void NeonsTablesRefresh(int theSeconds) { itsNeonsTablesRefresh = theSeconds; }
+	int NeonsTablesRefresh() const { return itsNeonsTablesRefresh; }
 	std::vector<std::vector<std::string>> GetGridGeoms(const std::string& ref_prod, const std::string& analtime,
 	                                                   const std::string& geom_name = "");
 
@@ -61,10 +82,29 @@ class NFmiNeonsDB : public NFmiOracle
 
 	std::string GetLatestTime(const std::string& ref_prod, const std::string& geom_name = "", unsigned int offset = 0);
 
+	/*
+	 * The count latest base dates (newest first) of a model by geometry name,
+	 * with one query. Key "" has the dates over all geometries, as given by
+	 * GetLatestTime() without geometry name. With LatestTimeTTL() > 0 the
+	 * results are cached for that many seconds and GetLatestTime() is served
+	 * from them.
+	 */
+
+	std::map<std::string, std::vector<std::string>> GetLatestTimes(const std::string& ref_prod, unsigned int count,
+	                                                               const std::string& geom_name = "");
+	void LatestTimeTTL(int theSeconds) { itsLatestTimeTTL = theSeconds; }
+	int LatestTimeTTL() const { return itsLatestTimeTTL; }
+
 	short Id() { return itsId; }
 	void SQLDateMask(const std::string& theDateMask);
 
    private:
+	void AddStation(const std::vector<std::string>& values,
+	                std::map<int, std::map<std::string, std::string>>& stationlist);
+	void LoadStationCatalog();
+	void LoadNeonsTables(const std::string& producer_name);
+	static std::string NeonsTime(const std::string& theTime);
+
 	// These maps are used for caching
 
 	std::map<std::string, std::map<std::string, std::string>> datasetinfo;
@@ -79,6 +119,34 @@ class NFmiNeonsDB : public NFmiOracle
 	std::map<std::string, long> gridparamid;
 	std::map<unsigned long, std::map<std::string, std::string>> gridmodeldefinition;
 
+	// Station catalog in GetStationListForArea() order, and spatial index over it
+	std::vector<std::vector<std::string>> stationcatalog;
+	NFmiStationIndex stationindex;
+	bool itsStationIndex;
+	bool itsStationCatalogLoaded;
+
+	struct LatestTimes
+	{
+		time_t fetched;
+		unsigned int count;
+		std::map<std::string, std::vector<std::string>> times;
+	};
+
+	std::map<std::string, LatestTimes> latesttimes;
+	int itsLatestTimeTTL;
+
+	// as_lltbufr tables by producer, indexed by (min_dat, max_dat) as YYYYMMDDHH24MISS
+
+	struct NeonsTables
+	{
+		NFmiIntervalIndex<std::string, std::string> index;
+		std::string maxdat;
+		time_t loaded;
+	};
+
+	std::map<std::string, NeonsTables> neonstables;
+	int itsNeonsTablesRefresh;
+
 	short itsId;  // Only for connection pooling
 };
 
@@ -103,20 +171,47 @@ class NFmiNeonsDBPool
 	void Username(const std::string& theUsername) { itsUsername = theUsername; }
 	void Password(const std::string& thePassword) { itsPassword = thePassword; }
 	void Database(const std::string& theDatabase) { itsDatabase = theDatabase; }
+
+	/*
+	 * Number of physical server attachments shared by the workers. With zero
+	 * (default) every worker has an attachment of its own, otherwise workers
+	 * begin their sessions over one of theAttachments shared attachments.
+	 * Must be set before first connection is requested.
+	 */
+
+	void ServerAttachments(int theAttachments);
+	int ServerAttachments() const { return itsServerAttachments; }
+
+	NFmiDBPoolStatistics Statistics();
+	void ResetStatistics();
+
    private:
 	// Default to two workers
 
 	NFmiNeonsDBPool();
 
+	void Leased(size_t theWorker, const std::chrono::steady_clock::time_point& theStart, bool theWaited);
+	void AttachWorker(size_t theWorker);
+	bool StaleAttachment(size_t theWorker) const;
+	void ResetWorker(size_t theWorker);
+
 	static NFmiNeonsDBPool* itsInstance;
 
 	int itsMaxWorkers;
 	std::vector<int> itsWorkingList;
 	std::vector<NFmiNeonsDB*> itsWorkerList;
 
+	int itsServerAttachments;
+	std::vector<NFmiNeonsDB*> itsServerList;
+	std::vector<NFmiNeonsDB*> itsRetiredServerList;  // lost attachments still referred to by workers
+
 	std::mutex itsGetMutex;
 	std::mutex itsReleaseMutex;
 
+	std::mutex itsStatisticsMutex;
+	NFmiDBPoolStatistics itsStatistics;
+	std::vector<std::chrono::steady_clock::time_point> itsLeaseTime;
+
 	bool itsExternalAuthentication;
 	bool itsReadWriteTransaction;
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "NFmiCancellationToken.h"
 #include "NFmiDatabase.h"
 
 #include "otlsettings.h"
@@ -30,8 +31,18 @@ class NFmiOracle : public NFmiDatabase
 	std::vector<std::string> FetchRow(void);
 	std::vector<std::string> FetchRowFromCursor(void);
 
+	// Fetch at most theMaxRows rows from ref cursor, fewer (or none) at the end of cursor
+	std::vector<std::vector<std::string>> FetchRowsFromCursor(size_t theMaxRows);
+
 	void Execute(const std::string& sql);
+
+	/*
+	 * Execute a function returning a ref cursor. Rows of the cursor are
+	 * fetched from server buffer_size rows at a time.
+	 */
+
 	void ExecuteProcedure(const std::string& sql);
+	void ExecuteProcedure(const std::string& sql, const unsigned int buffer_size);
 
 	std::string MakeDate(const otl_datetime& datetime);
 	// std::string MakeNEONSDate(const otl_datetime &datetime);
@@ -51,6 +62,31 @@ class NFmiOracle : public NFmiDatabase
 
 	void DateFormat(const std::string& dateFormat);
 
+	/*
+	 * Timeout in milliseconds for each round trip to server (OCI call timeout),
+	 * 0 = no timeout. A timed out call fails with ORA-03156.
+	 */
+
+	void CallTimeout(int theTimeout)
+	{
+		call_timeout_ = theTimeout;
+	}
+	int CallTimeout() const
+	{
+		return call_timeout_;
+	}
+
+	/*
+	 * Set (or remove with nullptr) cancellation token for the following
+	 * calls. Cancelling the token breaks the running call, which then fails
+	 * with ORA-01013, and a deadline of the token shortens the call timeout.
+	 * With a shared server attachment the running call is not broken, since
+	 * that could hit a call of another session; the token is then only
+	 * checked before each call.
+	 */
+
+	void CancellationToken(NFmiCancellationToken* theToken);
+
 	bool Verbose()
 	{
 		return verbose_;
@@ -64,6 +100,15 @@ class NFmiOracle : public NFmiDatabase
 	void Attach();
 	void Detach();
 
+	/*
+	 * Share the server attachment of another connection instead of opening
+	 * a physical connection of our own. Sessions are begun and ended on a
+	 * private service context, so many connections can multiplex over a few
+	 * attachments. OCI serializes calls that go through the same attachment.
+	 */
+
+	void Attach(NFmiOracle& theServer);
+
 	/*
 	 * This function can be called directly by the connection pool, or the library
 	 * can take care of calling it. If latter option is used, the session will
@@ -84,6 +129,12 @@ class NFmiOracle : public NFmiDatabase
 	void PooledConnection(bool pooled_connection);
 	bool PooledConnection() const;
 
+	// True after a call has failed because the server connection was lost
+	bool ConnectionLost() const
+	{
+		return connection_lost_;
+	}
+
 	oracle::otl_connect* RawConnection()
 	{
 		return &db_;
@@ -106,4 +157,28 @@ class NFmiOracle : public NFmiDatabase
 	bool initialized_;
 	bool pooled_connection_;
 	bool credentials_set_;
+
+	int reconnects_;  // number of times a lost session was re-established
+	bool connection_lost_;
+
+	// Set when sharing the server attachment of another connection
+
+	NFmiOracle* server_;
+	OCISvcCtx* svchp_;
+	OCISession* authp_;
+	OCIError* errhp_;
+
+	int call_timeout_;
+	int applied_timeout_;  // call timeout set to current service context
+	NFmiCancellationToken* token_;
+	size_t token_id_;
+
+   private:
+	void PrepareCall();
+	void ResetCall(int theCode);
+	OCISvcCtx* ServiceContext();
+	OCIError* ErrorHandle();
+	void CheckOCI(int theStatus, const std::string& theWhat);
+	void FreeSharedHandles();
+	void NoteError(int theCode);
 };
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "NFmiPostgreSQL.h"
+#include "NFmiMovingStationTracks.h"
+#include "NFmiStationIndex.h"
 //#include "NFmiOracle.h"
 
 #include <map>
+#include <set>
 
 class NFmiPGCLDB : public NFmiPostgreSQL 
 {
@@ -29,6 +32,26 @@ class NFmiPGCLDB : public NFmiPostgreSQL
 	                                                                        double max_latitude, double min_latitude,
 	                                                                        double max_longitude, double min_longitude);
 
+	/*
+	 * Moving stations (producer 20022): position at theTime (YYYYMMDDHH24MISS,
+	 * empty for latest), interpolated from the position history of the last
+	 * MovingTrackHours() hours (default 72). GetStationInfo() gives the latest.
+	 */
+
+	std::map<std::string, std::string> GetMovingStationInfo(unsigned long station_id, const std::string& theTime = "");
+	void MovingTrackHours(int theHours) { itsMovingTrackHours = theHours; }
+	int MovingTrackHours() const { return itsMovingTrackHours; }
+
+	/*
+	 * When enabled, GetStationListForArea() is answered from a per-producer
+	 * station catalog with a spatial index, read from database when the
+	 * producer is first queried. Loading the catalog also fills the caches of
+	 * GetStationInfo() for all stations of the producer.
+	 */
+
+	void StationCatalog(bool theStationCatalog) { itsStationCatalog = theStationCatalog; }
+	bool StationCatalog() const { return itsStationCatalog; }
+
 	std::map<std::string, std::string> GetParameterDefinition(unsigned long producer_id, unsigned long universal_id);
 	std::map<std::string, std::string> GetProducerDefinition(unsigned long producer_id);
 	std::vector<std::map<std::string, std::string>> GetParameterMapping(unsigned long producer_id,
@@ -46,6 +69,14 @@ class NFmiPGCLDB : public NFmiPostgreSQL
 	                                                     bool aggressive_cache);
 	std::map<std::string, std::string> GetExtSynopStationInfo(unsigned long station_id, bool aggressive_cache);
 
+	std::string StationListQuery(unsigned long producer_id, double max_latitude, double min_latitude,
+	                             double max_longitude, double min_longitude);
+	std::map<std::string, std::string> StationListRow(const std::vector<std::string>& values);
+	void CacheStationInfo(unsigned long producer_id, int id, const std::map<std::string, std::string>& station);
+	void LoadStationCatalog(unsigned long producer_id);
+	void RefreshMovingTracks();
+	void AddMovingRows(bool theWatermark = true);
+
 	std::map<std::string, std::vector<std::map<std::string, std::string>>> parametermapping;
 	std::map<unsigned long, std::map<unsigned long, std::map<std::string, std::string>>> parameterinfo;
 	std::map<unsigned long, std::map<std::string, std::string>> road_weather_stations;
@@ -53,5 +84,15 @@ class NFmiPGCLDB : public NFmiPostgreSQL
 	std::map<unsigned long, std::map<std::string, std::string>> extsynop_stations;
 	std::map<std::string, std::map<std::string, std::string>> fmi_stations;
 	std::map<unsigned long, std::map<std::string, std::string>> producerinfo;
+
+	// Station catalogs (id and station) and spatial indexes over them by producer
+	std::map<unsigned long, std::vector<std::pair<int, std::map<std::string, std::string>>>> stationcatalog;
+	std::map<unsigned long, NFmiStationIndex> stationindex;
+	bool itsStationCatalog;
+
+	NFmiMovingStationTracks movingtracks;
+	std::set<unsigned long> unknown_moving_stations;  // until next refresh
+	time_t itsMovingTracksRefreshed;
+	int itsMovingTrackHours;
 	short itsId;
 };
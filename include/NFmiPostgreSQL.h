@@ -1,7 +1,14 @@
 #pragma once
 
+#include "NFmiCancellationToken.h"
 #include "NFmiDatabase.h"
+#include "NFmiTask.h"
 
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <pqxx/connection>
 #include <pqxx/nontransaction>
 #include <pqxx/result>
@@ -35,6 +42,89 @@ class NFmiPostgreSQL : public NFmiDatabase
 	void Commit();
 	void Rollback();
 
+	/*
+	 * Statement timeout in milliseconds for all queries of this connection,
+	 * 0 = no timeout. The timeout is sent to server together with the next
+	 * query, so changing it does not cost a round trip.
+	 */
+
+	void StatementTimeout(int theTimeout) { statement_timeout_ = theTimeout; }
+	int StatementTimeout() const { return statement_timeout_; }
+
+	/*
+	 * Set (or remove with nullptr) cancellation token for the following
+	 * queries. Cancelling the token cancels the running query on server,
+	 * and a deadline of the token shortens the statement timeout.
+	 */
+
+	void CancellationToken(NFmiCancellationToken* theToken);
+
+	// Identifies the database of this connection, for caches shared between connections
+	std::string ConnectionKey() const
+	{
+		return user_ + "@" + hostname_ + ":" + std::to_string(port_) + "/" + database_;
+	}
+
+	/*
+	 * Asynchronous queries. Queries are sent over a separate non-blocking
+	 * connection, which is opened on first use, and can be queued without
+	 * waiting for the previous ones to complete. Results are delivered only
+	 * from PollAsync() or WaitAsync(), called by the thread that owns this
+	 * object: a future returned by QueryAsync() must not be waited on before
+	 * the event loop has been driven.
+	 */
+
+	typedef std::vector<std::vector<std::string>> AsyncResult;
+	typedef std::function<void(AsyncResult&& theResult, std::exception_ptr theError)> AsyncCallback;
+
+	void QueryAsync(const std::string& sql, AsyncCallback theCallback);
+	std::future<AsyncResult> QueryAsync(const std::string& sql);
+
+	// Wait at most theTimeout milliseconds (-1 = forever) for results, returns number of completed queries
+	size_t PollAsync(int theTimeout = -1);
+
+	// Drive the event loop until all queued queries have completed
+	void WaitAsync();
+	size_t PendingAsync() const { return async_queue_.size(); }
+
+#ifdef FMIDB_HAVE_COROUTINES
+	/*
+	 * Awaitable query: the coroutine is suspended until the result arrives
+	 * and is resumed from PollAsync(). The whole result set is returned at
+	 * once, so there is no separate awaitable for fetching rows.
+	 */
+
+	class QueryAwaitable
+	{
+	   public:
+		QueryAwaitable(NFmiPostgreSQL& theDatabase, const std::string& sql) : db_(theDatabase), sql_(sql) {}
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> theHandle)
+		{
+			db_.QueryAsync(sql_,
+			               [this, theHandle](AsyncResult&& theResult, std::exception_ptr theError)
+			               {
+				               result_ = std::move(theResult);
+				               error_ = theError;
+				               theHandle.resume();
+			               });
+		}
+		AsyncResult await_resume()
+		{
+			if (error_) std::rethrow_exception(error_);
+			return std::move(result_);
+		}
+
+	   private:
+		NFmiPostgreSQL& db_;
+		std::string sql_;
+		AsyncResult result_;
+		std::exception_ptr error_;
+	};
+
+	QueryAwaitable AwaitQuery(const std::string& sql) { return QueryAwaitable(*this, sql); }
+#endif
+
 	int Id() { return id_; }
    protected:
 	std::unique_ptr<pqxx::connection> db_;
@@ -47,4 +137,33 @@ class NFmiPostgreSQL : public NFmiDatabase
 	int port_;
 
 	int id_;
+
+	int statement_timeout_;
+	int current_timeout_;  // statement_timeout last sent to server, -1 if unknown
+
+	NFmiCancellationToken* token_;
+	size_t token_id_;
+
+	std::string PrepareQuery(const std::string& sql);
+	int QueryTimeout() const;
+
+   private:
+	struct AsyncQuery
+	{
+		std::string sql;
+		AsyncCallback callback;
+		AsyncResult result;
+		std::string error;
+	};
+
+	void OpenAsync();
+	void CloseAsync();
+	void SendAsync(const AsyncQuery& theQuery);
+	void CompleteAsync();
+	void FailAsync(const std::string& theError);
+
+	struct pg_conn* async_conn_;
+	struct pg_cancel* async_cancel_;  // for cancelling from the token's thread
+	std::mutex async_cancel_mutex_;
+	std::deque<AsyncQuery> async_queue_;
 };
@@ -1,9 +1,18 @@
 #pragma once
 
+#include "NFmiDBPoolStatistics.h"
+#include "NFmiIntervalIndex.h"
 #include "NFmiPostgreSQL.h"
+#include "NFmiStationIndex.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
 #include <map>
 #include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
 
 // from radon table 'network'
 enum FmiRadonStationNetwork
@@ -16,6 +25,50 @@ enum FmiRadonStationNetwork
 	kFmiSIDNetwork
 };
 
+// Lease priority for NFmiRadonDBPool::GetConnection()
+enum FmiDBPoolPriority
+{
+	kNormalPriority = 0,
+	kHighPriority
+};
+
+// Lookup keys for the batch parameter lookups, fields as in the single-key versions
+
+struct NFmiGrib1ParameterKey
+{
+	long producerId;
+	long tableVersion;
+	long paramId;
+	long timeRangeIndicator;
+	long levelId;
+	double levelValue;
+};
+
+struct NFmiGrib2ParameterKey
+{
+	long producerId;
+	long discipline;
+	long category;
+	long paramId;
+	long levelId;
+	double levelValue;
+	long typeOfStatisticalProcessing;
+};
+
+struct NFmiNetCDFParameterKey
+{
+	long producerId;
+	std::string paramName;
+	long levelId;
+	double levelValue;
+};
+
+struct NFmiGeoTIFFParameterKey
+{
+	long producerId;
+	std::string paramName;
+};
+
 class NFmiRadonDBPool;
 
 class NFmiRadonDB : public NFmiPostgreSQL
@@ -51,6 +104,71 @@ class NFmiRadonDB : public NFmiPostgreSQL
 	std::map<std::string, std::string> GetParameterFromNetCDF(long producerId, const std::string& paramName,
 	                                                          long levelId, double levelValue);
 	std::map<std::string, std::string> GetParameterFromGeoTIFF(long producerId, const std::string& paramName);
+
+	/*
+	 * Batch versions of the parameter lookups. Keys that are not in cache are
+	 * resolved with one query (plus one for the GRIB2 template fallback), and
+	 * the cache is filled for each key. Results are in the order of the keys.
+	 */
+
+	std::vector<std::map<std::string, std::string>> GetParametersFromGrib1(
+	    const std::vector<NFmiGrib1ParameterKey>& keys);
+	std::vector<std::map<std::string, std::string>> GetParametersFromGrib2(
+	    const std::vector<NFmiGrib2ParameterKey>& keys);
+	std::vector<std::map<std::string, std::string>> GetParametersFromNetCDF(
+	    const std::vector<NFmiNetCDFParameterKey>& keys);
+	std::vector<std::map<std::string, std::string>> GetParametersFromGeoTIFF(
+	    const std::vector<NFmiGeoTIFFParameterKey>& keys);
+
+	/*
+	 * When enabled, two consecutive GRIB1/GRIB2 parameter cache misses that
+	 * differ only by level value make the lookup fetch all level rows of that
+	 * parameter and level type at once. Further level values are then resolved
+	 * from memory with the same precedence rules as the SQL query.
+	 */
+
+	void LevelPrefetch(bool theLevelPrefetch)
+	{
+		itsLevelPrefetch = theLevelPrefetch;
+	}
+	bool LevelPrefetch() const
+	{
+		return itsLevelPrefetch;
+	}
+
+	/*
+	 * Reads all geometry definitions into the cache used by
+	 * GetGeometryDefinition(geom_name) with one query per projection view.
+	 * With GeometryPreload(true) this is done on the first cache miss.
+	 */
+
+	void PreloadGeometries();
+	void GeometryPreload(bool theGeometryPreload)
+	{
+		itsGeometryPreload = theGeometryPreload;
+	}
+	bool GeometryPreload() const
+	{
+		return itsGeometryPreload;
+	}
+
+	/*
+	 * When enabled, area based GetGeometryDefinition() lookups are matched in
+	 * memory against a catalog of the geometries of the projection, which is
+	 * read from the geom_*_v view on first use. Origin and grid spacing are
+	 * compared with a tolerance instead of exact values. A geometry that is not
+	 * in the catalog is looked up from database as before.
+	 */
+
+	void GeometryCatalog(bool theGeometryCatalog)
+	{
+		itsGeometryCatalog = theGeometryCatalog;
+	}
+	bool GeometryCatalog() const
+	{
+		return itsGeometryCatalog;
+	}
+
 	std::map<std::string, std::string> GetParameterFromDatabaseName(long producerId, const std::string& paramName,
 	                                                                int levelId = -1, double levelValue = 32700.f);
 	std::map<std::string, std::string> GetParameterPrecision(const std::string& paramName);
@@ -74,11 +192,86 @@ class NFmiRadonDB : public NFmiPostgreSQL
 	                                                         double dj, int projectionId);
 	std::string GetLatestTime(int producer_id, const std::string& geom_name = "", unsigned int offset = 0);
 	std::string GetLatestTime(const std::string& ref_prod, const std::string& geom_name = "", unsigned int offset = 0);
+
+	/*
+	 * Loads the as_grid_v rows of a producer for analysis times between
+	 * theStart and theEnd ('YYYY-MM-DD HH24:MI:SS') into an availability index.
+	 * GetGridGeoms() and GetTableName() for times in that range are then
+	 * answered from memory. The whole range is read again every
+	 * AvailabilityRefresh() seconds (default 60).
+	 */
+
+	void LoadGridAvailability(long producer_id, const std::string& theStart, const std::string& theEnd);
+	void AvailabilityRefresh(int theSeconds)
+	{
+		itsAvailabilityRefresh = theSeconds;
+	}
+	int AvailabilityRefresh() const
+	{
+		return itsAvailabilityRefresh;
+	}
+
+	/*
+	 * The count latest analysis times (newest first) of a producer by geometry
+	 * name, with one query. Key "" has the times over all geometries, as given
+	 * by GetLatestTime() without geometry name; with geom_name only that
+	 * geometry is included.
+	 *
+	 * With LatestTimeTTL() > 0 the results are cached for that many seconds and
+	 * GetLatestTime() is served from them.
+	 */
+
+	std::map<std::string, std::vector<std::string>> GetLatestTimes(int producer_id, unsigned int count,
+	                                                               const std::string& geom_name = "");
+	void LatestTimeTTL(int theSeconds)
+	{
+		itsLatestTimeTTL = theSeconds;
+	}
+	int LatestTimeTTL() const
+	{
+		return itsLatestTimeTTL;
+	}
+
+	/*
+	 * Stale-while-revalidate for GetLatestTime() and GetGridGeoms(). With
+	 * theSeconds > 0 their results are kept in a cache shared by all instances
+	 * (keyed by database); a result older than theSeconds is returned as is
+	 * while it is queued for a refresh. Refreshes run one at a time in one
+	 * background thread per cache, over a connection to the database of the
+	 * caller that the thread keeps open. After three failed refreshes in a row
+	 * the result is dropped and read again by the next caller. 0 (default)
+	 * disables: GetLatestTime() is not cached and GetGridGeoms() uses the
+	 * per-instance cache.
+	 */
+
+	static void RefreshInterval(int theSeconds);
 	std::map<std::string, std::string> GetStationDefinition(FmiRadonStationNetwork networkType, unsigned long stationId,
 	                                                        bool aggressive_cache = false);
 	std::map<std::string, std::string> GetStationDefinition(FmiRadonStationNetwork networkType,
 	                                                        const std::string& stationId,
 	                                                        bool aggressive_cache = false);  // overload for icao
+
+	/*
+	 * The count stations nearest to a point by great circle distance, nearest
+	 * first. With maxDistance (km) > 0 only stations within that distance are
+	 * returned, and with a network other than kUnknownNetwork only stations
+	 * that belong to that network. Stations are read from database once per
+	 * connection, queries are then answered from memory.
+	 *
+	 * GetNearestStations() returns the fields of GetStationDefinition() and
+	 * "distance" (km), GetNearestStationIds() radon station ids and distances.
+	 */
+
+	std::vector<std::map<std::string, std::string>> GetNearestStations(
+	    double latitude, double longitude, size_t count, double maxDistance = 0,
+	    FmiRadonStationNetwork networkType = kUnknownNetwork);
+	std::vector<std::pair<unsigned long, double>> GetNearestStationIds(
+	    double latitude, double longitude, size_t count, double maxDistance = 0,
+	    FmiRadonStationNetwork networkType = kUnknownNetwork);
+
+	// Batch version of GetStationDefinition(), stations given as (network, local id) pairs
+	std::vector<std::map<std::string, std::string>> GetStationDefinitions(
+	    const std::vector<std::pair<FmiRadonStationNetwork, std::string>>& stations);
 	std::map<std::string, std::string> GetLevelTransform(long producer_id, long paramId, long source_level_id,
 	                                                     double source_level_value);
 	double GetProbabilityLimitForStation(long stationId, const std::string& paramName);
@@ -93,7 +286,92 @@ class NFmiRadonDB : public NFmiPostgreSQL
 
 	int RadonVersion();
 
+#ifdef FMIDB_HAVE_COROUTINES
+	/*
+	 * Awaitable versions of the most common lookups. They share the caches
+	 * with the synchronous versions (including those of LatestTimeTTL(),
+	 * RefreshInterval() and GeometryPreload()), and a cache hit completes
+	 * without suspending. Queries are run with AwaitQuery(), so the event loop
+	 * (PollAsync() or WaitAsync()) must be driven by the owning thread.
+	 * Definitions are in NFmiRadonDBAsync.h.
+	 */
+
+	NFmiTask<std::map<std::string, std::string>> GetParameterFromGrib2Async(long producerId, long discipline,
+	                                                                        long category, long paramId, long levelId,
+	                                                                        double levelValue,
+	                                                                        long typeOfStatisticalProcessing = -1);
+	NFmiTask<std::map<std::string, std::string>> GetGeometryDefinitionAsync(std::string geom_name);
+	NFmiTask<size_t> PreloadGeometriesAsync();
+	NFmiTask<std::map<std::string, std::string>> GetProducerDefinitionAsync(unsigned long producer_id);
+	NFmiTask<std::map<std::string, std::string>> GetProducerDefinitionAsync(std::string producer_name);
+	NFmiTask<std::string> GetLatestTimeAsync(int producer_id, std::string geom_name = "", unsigned int offset = 0);
+	NFmiTask<std::string> GetLatestTimeAsync(std::string ref_prod, std::string geom_name = "",
+	                                         unsigned int offset = 0);
+#endif
+
    private:
+	// Query builders and row parsers shared by the synchronous and asynchronous lookups
+
+	static std::string ParameterGrib2Key(long producerId, long discipline, long category, long paramId, long levelId,
+	                                     double levelValue, long typeOfStatisticalProcessing);
+	static std::string ParameterGrib2Query(long producerId, long discipline, long category, long paramId,
+	                                       long levelId, double levelValue, long typeOfStatisticalProcessing);
+	static std::string ParameterGrib2TemplateQuery(long discipline, long category, long paramId,
+	                                               long typeOfStatisticalProcessing);
+	static std::map<std::string, std::string> ParameterGrib2Row(const std::vector<std::string>& row, long discipline,
+	                                                            long category, long paramId,
+	                                                            long typeOfStatisticalProcessing);
+	static std::string GeometryQuery(const std::string& geom_name);
+	static std::string GeometryDetailQuery(int grid_type_id, const std::string& geometry_id, int radon_version);
+	static size_t GeometryIdColumn(int grid_type_id);
+	static std::string GeometryListQuery();
+	std::function<bool(const std::exception_ptr&)> OwnFailure() const;
+	bool PreloadGeometryRow(int grid_type_id, const std::map<std::string, std::vector<std::string>>& geoms,
+	                        const std::vector<std::string>& row);
+	static bool GeometryDetailRow(int grid_type_id, const std::vector<std::string>& row,
+	                              std::map<std::string, std::string>& ret);
+	static std::string ProducerQuery(unsigned long producer_id);
+	static std::string ProducerIdQuery(const std::string& producer_name);
+	static std::map<std::string, std::string> ProducerRow(const std::vector<std::string>& row);
+	static std::string Grib1ParameterKey(long producerId, long tableVersion, long paramId, long timeRangeIndicator,
+	                                     long levelId, double levelValue);
+	static std::map<std::string, std::string> Grib1ParameterRow(const std::vector<std::string>& row, long tableVersion,
+	                                                            long paramId);
+	static std::string NetCDFParameterKey(long producerId, const std::string& paramName, long levelId,
+	                                      double levelValue);
+	static std::map<std::string, std::string> NetCDFParameterRow(const std::vector<std::string>& row,
+	                                                             const std::string& paramName);
+	static std::map<std::string, std::string> GeoTIFFParameterRow(const std::vector<std::string>& row,
+	                                                              const std::string& paramName);
+	std::map<size_t, std::vector<std::string>> BatchQuery(const std::string& query);
+	bool PrefetchedLevel(const std::string& theLevelKey, const std::string& theQuery, size_t theLevelColumn,
+	                     double theLevelValue, std::vector<std::string>& theRow);
+	static std::string StationQuery(FmiRadonStationNetwork networkType);
+	static std::string StationCatalogQuery();
+	static std::map<std::string, std::string> StationRow(const std::vector<std::string>& row);
+	void LoadStationCatalog();
+	std::map<std::string, std::string> CatalogStation(FmiRadonStationNetwork networkType, const std::string& stationId);
+	std::vector<std::pair<size_t, double>> NearestStations(double latitude, double longitude, size_t count,
+	                                                       double maxDistance, FmiRadonStationNetwork networkType);
+	void CacheStation(const std::vector<std::string>& row);
+	std::map<std::string, std::string> CatalogGeometry(size_t ni, size_t nj, double lat, double lon, double di,
+	                                                   double dj, int projectionId);
+	std::vector<std::vector<std::string>> QueryGridGeoms(long producer_id, const std::string& analtime,
+	                                                     const std::string& geom_name);
+	std::string QueryLatestTime(int producer_id, const std::string& geom_name, unsigned int offset);
+	static std::string LatestTimeQuery(int producer_id, const std::string& producer_class,
+	                                   const std::string& geom_name, unsigned int offset);
+	static std::string LatestTimesQuery(int producer_id, const std::string& producer_class, unsigned int count,
+	                                    const std::string& geom_name);
+	std::string LatestTimeKey(int producer_id, const std::string& geom_name, unsigned int offset) const;
+	bool CachedLatestTime(int producer_id, const std::string& geom_name, unsigned int offset, std::string& theTime);
+	void CacheLatestTime(int producer_id, const std::string& geom_name, unsigned int offset,
+	                     const std::string& theTime);
+	bool CachedLatestTimes(int producer_id, unsigned int count, const std::string& geom_name,
+	                       std::map<std::string, std::vector<std::string>>& theTimes);
+	void CacheLatestTimes(int producer_id, unsigned int count, const std::string& geom_name,
+	                      const std::map<std::string, std::vector<std::string>>& theTimes);
+
 	// These maps are used for caching
 
 	std::map<std::string, std::map<std::string, std::string>> gribproducerinfo;
@@ -116,6 +394,70 @@ class NFmiRadonDB : public NFmiPostgreSQL
 	std::map<std::string, std::string> producermetadatainfo;
 	std::map<std::string, std::map<std::string, std::string>> tablenameinfo;
 
+	struct LatestTimes
+	{
+		time_t fetched;
+		unsigned int count;
+		std::map<std::string, std::vector<std::string>> times;
+	};
+
+	std::map<std::string, LatestTimes> latesttimes;
+
+	// Grid availability index by producer, as_grid_v rows by id:
+	// id, geometry_name, geometry_id, table_name, schema_name, partition_name,
+	// record_count, delete_time, analysis_time, min_analysis_time, max_analysis_time
+	// (times as seconds since epoch)
+
+	struct GridAvailability
+	{
+		time_t start;
+		time_t end;
+		time_t newest;
+		time_t refreshed;
+		std::map<std::string, std::vector<std::string>> rows;
+		NFmiIntervalIndex<long long, std::string> index;
+		std::map<std::pair<time_t, std::string>, std::string> tables;  // (analysis_time, geometry) -> id
+	};
+
+	std::map<long, GridAvailability> gridavailability;
+
+	GridAvailability* Availability(long producer_id, const std::string& analtime);
+	void ReadGridAvailability(long producer_id, GridAvailability& availability);
+	static time_t AvailabilityTime(const std::string& theTime);
+
+	// Geometry catalog: geometries by projection, ni and nj
+
+	struct GeometryArea
+	{
+		std::string id;
+		std::string name;
+		double first_lat;
+		double first_lon;
+		double di;
+		double dj;
+	};
+
+	std::map<std::tuple<int, size_t, size_t>, std::vector<GeometryArea>> geometrycatalog;
+	std::set<int> geometrycatalogprojections;
+	bool itsGeometryCatalog;
+	bool itsGeometryPreload;
+	bool itsGeometriesPreloaded;
+
+	// Station catalog with one record per station, positions by network and local id
+	// ("network_localid"), and spatial indexes by network (kUnknownNetwork: all stations)
+	std::vector<std::map<std::string, std::string>> stationcatalog;
+	std::map<std::string, size_t> stationids;
+	std::map<int, NFmiStationIndex> stationindexes;
+	bool itsStationCatalogLoaded;
+
+	int itsLatestTimeTTL;
+	int itsAvailabilityRefresh;
+
+	// Level prefetch: all level rows by parameter and level type, in query order
+	std::map<std::string, std::vector<std::vector<std::string>>> paramlevels;
+	std::string itsLastLevelMiss;
+	bool itsLevelPrefetch;
+
 	short itsId;  // Only for connection pooling
 	int itsRadonVersion;
 };
@@ -127,13 +469,40 @@ class NFmiRadonDBPool
 
 	~NFmiRadonDBPool();
 
-	NFmiRadonDB* GetConnection();
+	NFmiRadonDB* GetConnection(FmiDBPoolPriority thePriority = kNormalPriority);
 	void Release(NFmiRadonDB* theWorker);
 	void MaxWorkers(int theMaxWorkers);
 	int MaxWorkers() const
 	{
 		return itsMaxWorkers;
 	}
+
+	/*
+	 * Number of workers that are kept for high priority callers only. Normal
+	 * priority callers wait when all the other workers are leased, and always
+	 * give way to waiting high priority callers.
+	 */
+
+	void ReservedWorkers(int theReservedWorkers);
+	int ReservedWorkers() const
+	{
+		return itsReservedWorkers;
+	}
+
+	/*
+	 * When enabled, a thread gets back the worker it used last if that worker
+	 * is idle, so that the per-worker caches stay hot for the thread. Any idle
+	 * worker is returned if the previous one is busy.
+	 */
+
+	void StickyLeases(bool theStickyLeases)
+	{
+		itsStickyLeases = theStickyLeases;
+	}
+	bool StickyLeases() const
+	{
+		return itsStickyLeases;
+	}
 	void Username(const std::string& theUsername)
 	{
 		itsUsername = theUsername;
@@ -155,16 +524,54 @@ class NFmiRadonDBPool
 		itsPort = thePort;
 	}
 
+	/*
+	 * Add a database server (primary or read replica) to the pool. Leases are
+	 * spread over the endpoints by least outstanding leases relative to weight.
+	 * If no endpoints are added, Hostname() and Port() are used.
+	 */
+
+	void AddEndpoint(const std::string& theHostname, int thePort = 5432, int theWeight = 1);
+
+	NFmiDBPoolStatistics Statistics();
+	void ResetStatistics();
+
    private:
+	struct Endpoint
+	{
+		std::string hostname;
+		int port;
+		int weight;
+		int leases;     // number of workers currently leased from this endpoint
+		time_t failed;  // time of last failed connection attempt, 0 if healthy
+	};
+
 	NFmiRadonDBPool();
 
+	bool EndpointAvailable(size_t theEndpoint) const;
+	double EndpointLoad(size_t theEndpoint) const;
+	void CreateWorker(size_t theWorker);
+	bool Admissible(FmiDBPoolPriority thePriority) const;
+	NFmiRadonDB* Lease(size_t theWorker, FmiDBPoolPriority thePriority,
+	                   const std::chrono::steady_clock::time_point& theStart, bool theWaited);
+
 	static NFmiRadonDBPool* itsInstance;
 
 	int itsMaxWorkers;
+	int itsReservedWorkers;
+	int itsHighPriorityWaiting;  // high priority callers blocked in GetConnection()
+	std::atomic<bool> itsStickyLeases;
+	std::map<std::thread::id, size_t> itsLastWorker;  // worker each thread leased last
 	std::vector<int> itsWorkingList;
 	std::vector<NFmiRadonDB*> itsWorkerList;
+	std::vector<size_t> itsWorkerEndpoint;
+	std::vector<Endpoint> itsEndpoints;
 
 	std::mutex itsGetMutex;
+	std::condition_variable itsReleaseCondition;
+
+	std::mutex itsStatisticsMutex;
+	NFmiDBPoolStatistics itsStatistics;
+	std::vector<std::chrono::steady_clock::time_point> itsLeaseTime;
 
 	std::string itsUsername;
 	std::string itsPassword;
@@ -172,3 +579,7 @@ class NFmiRadonDBPool
 	std::string itsHostname;
 	int itsPort;
 };
+
+#ifdef FMIDB_HAVE_COROUTINES
+#include "NFmiRadonDBAsync.h"
+#endif
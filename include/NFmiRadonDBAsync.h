@@ -0,0 +1,284 @@
+#pragma once
+
+/*
+ * Definitions of the awaitable NFmiRadonDB lookups. Included from
+ * NFmiRadonDB.h when coroutines are available; do not include directly.
+ *
+ * These mirror the synchronous lookups in NFmiRadonDB.cpp and use the same
+ * query builders, row parsers and caches.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <string>
+
+inline NFmiTask<std::map<std::string, std::string>> NFmiRadonDB::GetParameterFromGrib2Async(
+    long producerId, long discipline, long category, long paramId, long levelId, double levelValue,
+    long typeOfStatisticalProcessing)
+{
+	const std::string key =
+	    ParameterGrib2Key(producerId, discipline, category, paramId, levelId, levelValue, typeOfStatisticalProcessing);
+
+	const auto it = paramgrib2info.find(key);
+
+	if (it != paramgrib2info.end())
+	{
+		FMIDEBUG(std::cout << "DEBUG: ParameterFromGrib2() cache hit for " << key << std::endl);
+
+		co_return it->second;
+	}
+
+	auto rows = co_await AwaitQuery(
+	    ParameterGrib2Query(producerId, discipline, category, paramId, levelId, levelValue, typeOfStatisticalProcessing));
+
+	if (rows.empty())
+	{
+		rows = co_await AwaitQuery(ParameterGrib2TemplateQuery(discipline, category, paramId, typeOfStatisticalProcessing));
+	}
+
+	std::map<std::string, std::string> ret;
+
+	if (rows.empty())
+	{
+		FMIDEBUG(std::cout << "DEBUG Parameter not found\n");
+	}
+	else
+	{
+		ret = ParameterGrib2Row(rows[0], discipline, category, paramId, typeOfStatisticalProcessing);
+	}
+
+	paramgrib2info[key] = ret;
+
+	co_return ret;
+}
+
+inline NFmiTask<std::map<std::string, std::string>> NFmiRadonDB::GetGeometryDefinitionAsync(std::string geom_name)
+{
+	const auto it = geometryinfo.find(geom_name);
+
+	if (it != geometryinfo.end())
+	{
+		FMIDEBUG(std::cout << "DEBUG: GetGeometryDefinition() cache hit!" << std::endl);
+
+		co_return it->second;
+	}
+
+	if (itsGeometryPreload && !itsGeometriesPreloaded)
+	{
+		co_await PreloadGeometriesAsync();
+
+		const auto preloaded = geometryinfo.find(geom_name);
+
+		if (preloaded != geometryinfo.end())
+		{
+			co_return preloaded->second;
+		}
+	}
+
+	auto rows = co_await AwaitQuery(GeometryQuery(geom_name));
+
+	if (rows.empty())
+	{
+		co_return std::map<std::string, std::string>();
+	}
+
+	std::map<std::string, std::string> ret;
+
+	ret["id"] = rows[0][0];
+	ret["name"] = rows[0][1];
+	ret["grid_type_id"] = rows[0][2];
+
+	const int grid_type_id = std::stoi(rows[0][2]);
+
+	if (grid_type_id == 2 && itsRadonVersion == -1)
+	{
+		const auto version = co_await AwaitQuery("SELECT radon_version_f()");
+
+		if (version.empty())
+		{
+			throw std::runtime_error("Unable to get radon version");
+		}
+
+		itsRadonVersion = std::stoi(version[0][0]);
+	}
+
+	const std::string query = GeometryDetailQuery(grid_type_id, rows[0][0], itsRadonVersion);
+
+	if (query.empty())
+	{
+		co_return std::map<std::string, std::string>();
+	}
+
+	rows = co_await AwaitQuery(query);
+
+	if (rows.empty() || !GeometryDetailRow(grid_type_id, rows[0], ret))
+	{
+		co_return std::map<std::string, std::string>();
+	}
+
+	geometryinfo[geom_name] = ret;
+
+	co_return ret;
+}
+
+inline NFmiTask<size_t> NFmiRadonDB::PreloadGeometriesAsync()
+{
+	std::map<std::string, std::vector<std::string>> geoms;  // id -> id, name, projection_id
+	std::set<int> gridTypes;
+
+	for (auto& row : co_await AwaitQuery(GeometryListQuery()))
+	{
+		gridTypes.insert(std::stoi(row[2]));
+		geoms[row[0]] = std::move(row);
+	}
+
+	if (gridTypes.count(2) && itsRadonVersion == -1)
+	{
+		const auto version = co_await AwaitQuery("SELECT radon_version_f()");
+
+		if (version.empty())
+		{
+			throw std::runtime_error("Unable to get radon version");
+		}
+
+		itsRadonVersion = std::stoi(version[0][0]);
+	}
+
+	size_t count = 0;
+
+	for (int grid_type_id : gridTypes)
+	{
+		const std::string query = GeometryDetailQuery(grid_type_id, "", grid_type_id == 2 ? itsRadonVersion : 0);
+
+		if (query.empty())
+		{
+			continue;
+		}
+
+		for (const auto& row : co_await AwaitQuery(query))
+		{
+			if (PreloadGeometryRow(grid_type_id, geoms, row))
+			{
+				count++;
+			}
+		}
+	}
+
+	itsGeometriesPreloaded = true;
+
+	FMIDEBUG(std::cout << "DEBUG: PreloadGeometriesAsync() read " << count << " geometries" << std::endl);
+
+	co_return count;
+}
+
+inline NFmiTask<std::map<std::string, std::string>> NFmiRadonDB::GetProducerDefinitionAsync(unsigned long producer_id)
+{
+	const auto it = producerinfo.find(producer_id);
+
+	if (it != producerinfo.end())
+	{
+		FMIDEBUG(std::cout << "DEBUG: GetProducerDefinition() cache hit!" << std::endl);
+
+		co_return it->second;
+	}
+
+	const auto rows = co_await AwaitQuery(ProducerQuery(producer_id));
+
+	std::map<std::string, std::string> ret;
+
+	if (!rows.empty())
+	{
+		ret = ProducerRow(rows[0]);
+
+		producerinfo[producer_id] = ret;
+	}
+
+	co_return ret;
+}
+
+inline NFmiTask<std::map<std::string, std::string>> NFmiRadonDB::GetProducerDefinitionAsync(std::string producer_name)
+{
+	const auto rows = co_await AwaitQuery(ProducerIdQuery(producer_name));
+
+	if (rows.empty())
+	{
+		co_return std::map<std::string, std::string>();
+	}
+
+	co_return co_await GetProducerDefinitionAsync(std::stoul(rows[0][0]));
+}
+
+inline NFmiTask<std::string> NFmiRadonDB::GetLatestTimeAsync(int producer_id, std::string geom_name,
+                                                             unsigned int offset)
+{
+	std::string ret;
+
+	if (CachedLatestTime(producer_id, geom_name, offset, ret))
+	{
+		co_return ret;
+	}
+
+	if (itsLatestTimeTTL > 0)
+	{
+		// Same cached list of latest times as QueryLatestTime()
+
+		const unsigned int count = std::max(offset + 1, 10u);
+		std::map<std::string, std::vector<std::string>> times;
+
+		if (!CachedLatestTimes(producer_id, count, geom_name, times))
+		{
+			auto prod = co_await GetProducerDefinitionAsync(static_cast<unsigned long>(producer_id));
+
+			if (!prod.empty())
+			{
+				for (const auto& row : co_await AwaitQuery(LatestTimesQuery(producer_id, prod["producer_class"],
+				                                                            count, geom_name)))
+				{
+					times[row[0]].push_back(row[1]);
+				}
+
+				CacheLatestTimes(producer_id, count, geom_name, times);
+			}
+		}
+
+		const auto it = times.find(geom_name);
+
+		if (it != times.end() && it->second.size() > offset)
+		{
+			ret = it->second[offset];
+		}
+	}
+	else
+	{
+		auto prod = co_await GetProducerDefinitionAsync(static_cast<unsigned long>(producer_id));
+
+		if (!prod.empty())
+		{
+			const auto rows =
+			    co_await AwaitQuery(LatestTimeQuery(producer_id, prod["producer_class"], geom_name, offset));
+
+			if (!rows.empty())
+			{
+				ret = rows[0][0];
+			}
+		}
+	}
+
+	CacheLatestTime(producer_id, geom_name, offset, ret);
+
+	co_return ret;
+}
+
+inline NFmiTask<std::string> NFmiRadonDB::GetLatestTimeAsync(std::string ref_prod, std::string geom_name,
+                                                             unsigned int offset)
+{
+	auto prod = co_await GetProducerDefinitionAsync(ref_prod);
+
+	if (prod.empty())
+	{
+		co_return std::string();
+	}
+
+	co_return co_await GetLatestTimeAsync(std::stoi(prod["producer_id"]), geom_name, offset);
+}
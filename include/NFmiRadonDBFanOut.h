@@ -0,0 +1,158 @@
+#pragma once
+
+#include "NFmiRadonDB.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Result of one lookup run by NFmiRadonDBFanOut: either a value or the
+ * exception the lookup threw.
+ */
+
+template <typename T>
+struct NFmiFanOutResult
+{
+	T value;
+	std::exception_ptr error;
+
+	bool Ok() const
+	{
+		return !error;
+	}
+
+	// Returns value or rethrows the error of the lookup
+	const T& Get() const
+	{
+		if (error)
+			std::rethrow_exception(error);
+
+		return value;
+	}
+};
+
+/*
+ * Runs a set of independent lookups in parallel over connections leased
+ * from NFmiRadonDBPool and gathers the results in input order.
+ *
+ * At most 'concurrency' connections are leased at a time (default and
+ * maximum: pool size minus one, so that one worker is always left for other
+ * callers). Each leased connection runs lookups until there are none left,
+ * so its per-worker caches are reused between the lookups. An error in one
+ * lookup does not affect the others.
+ *
+ * Run() must not be called while holding a lease from the pool, and lookups
+ * must not lease connections themselves: the leases of the fan-out could
+ * then wait for each other.
+ *
+ * Example:
+ *
+ *   std::vector<std::function<std::string(NFmiRadonDB&)>> lookups;
+ *   for (const auto& prod : producers)
+ *     lookups.push_back([=](NFmiRadonDB& db) { return db.GetLatestTime(prod); });
+ *
+ *   const auto results = NFmiRadonDBFanOut().Run(lookups);
+ */
+
+class NFmiRadonDBFanOut
+{
+   public:
+	explicit NFmiRadonDBFanOut(int theConcurrency = 0, FmiDBPoolPriority thePriority = kNormalPriority)
+	    : itsConcurrency(theConcurrency), itsPriority(thePriority)
+	{
+	}
+
+	template <typename T>
+	std::vector<NFmiFanOutResult<T>> Run(const std::vector<std::function<T(NFmiRadonDB&)>>& theLookups)
+	{
+		std::vector<NFmiFanOutResult<T>> results(theLookups.size());
+
+		if (theLookups.empty())
+		{
+			return results;
+		}
+
+		NFmiRadonDBPool* pool = NFmiRadonDBPool::Instance();
+
+		const int maxConcurrency = std::max(1, pool->MaxWorkers() - 1);
+
+		int concurrency = itsConcurrency > 0 ? std::min(itsConcurrency, maxConcurrency) : maxConcurrency;
+		concurrency = std::max(1, std::min(concurrency, static_cast<int>(theLookups.size())));
+
+		std::atomic<size_t> next(0);
+		std::vector<char> done(theLookups.size(), 0);
+		std::exception_ptr leaseError;
+		std::mutex leaseMutex;
+
+		auto work = [&]()
+		{
+			NFmiRadonDB* db = nullptr;
+
+			try
+			{
+				db = pool->GetConnection(itsPriority);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(leaseMutex);
+				leaseError = std::current_exception();
+				return;
+			}
+
+			size_t i;
+
+			while ((i = next++) < theLookups.size())
+			{
+				try
+				{
+					results[i].value = theLookups[i](*db);
+				}
+				catch (...)
+				{
+					results[i].error = std::current_exception();
+				}
+
+				done[i] = 1;
+			}
+
+			pool->Release(db);
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(concurrency - 1);
+
+		for (int t = 1; t < concurrency; t++)
+		{
+			threads.emplace_back(work);
+		}
+
+		// Calling thread takes part too
+		work();
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		// Lookups left over if no connection could be leased
+
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			if (!done[i])
+			{
+				results[i].error = leaseError;
+			}
+		}
+
+		return results;
+	}
+
+   private:
+	int itsConcurrency;
+	FmiDBPoolPriority itsPriority;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+
+/*
+ * Coalesces concurrent calls with the same key: the first caller runs the
+ * function, and callers that arrive while it is still running wait for and
+ * receive the same result (or exception) instead of running it again.
+ * Nothing is cached after the call has completed.
+ *
+ * The key must identify everything the result depends on, including the
+ * database when instances are shared between connections.
+ *
+ * A failure that belongs to the leading caller only, such as its own
+ * cancellation or timeout, is not shared: theOwnFailure classifies the
+ * exception, and if it returns true the waiting callers start over and one
+ * of them runs the function as the new leader.
+ */
+
+template <typename Key, typename Value>
+class NFmiSingleFlight
+{
+   public:
+	Value Do(const Key& theKey, const std::function<Value()>& theFunction,
+	         const std::function<bool(const std::exception_ptr&)>& theOwnFailure = nullptr)
+	{
+		std::unique_lock<std::mutex> lock(itsMutex);
+
+		auto it = itsCalls.find(theKey);
+
+		while (it != itsCalls.end())
+		{
+			auto result = it->second;
+			lock.unlock();
+
+			try
+			{
+				return result.get();
+			}
+			catch (const Retry&)
+			{
+			}
+
+			lock.lock();
+			it = itsCalls.find(theKey);
+		}
+
+		std::promise<Value> promise;
+		itsCalls.emplace(theKey, promise.get_future().share());
+		lock.unlock();
+
+		try
+		{
+			Value value = theFunction();
+			promise.set_value(value);
+			Forget(theKey);
+
+			return value;
+		}
+		catch (...)
+		{
+			const auto error = std::current_exception();
+
+			if (theOwnFailure && theOwnFailure(error))
+			{
+				promise.set_exception(std::make_exception_ptr(Retry()));
+			}
+			else
+			{
+				promise.set_exception(error);
+			}
+
+			Forget(theKey);
+
+			throw;
+		}
+	}
+
+   private:
+	// Given to waiting callers when the leader failed for its own reasons
+	struct Retry
+	{
+	};
+
+	void Forget(const Key& theKey)
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+		itsCalls.erase(theKey);
+	}
+
+	std::mutex itsMutex;
+	std::map<Key, std::shared_future<Value>> itsCalls;
+};
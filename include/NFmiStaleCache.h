@@ -0,0 +1,202 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+/*
+ * Shared cache with stale-while-revalidate semantics: a value older than the
+ * maximum age is still returned immediately and its key is queued for a
+ * refresh. Only a key that has never been loaded (or whose load failed) is
+ * loaded by the caller.
+ *
+ * Refreshes are run one at a time by a single worker thread owned by the
+ * cache. A key is queued at most once, however many readers see it stale.
+ * The worker is started on the first refresh and stopped and joined when the
+ * cache is destroyed; refreshes still queued then are dropped.
+ *
+ * A failed background refresh keeps the stale value and the refresh is
+ * retried on the next read. After theMaxFailures consecutive failed refreshes
+ * the value is dropped, so that the next read loads it (and sees the error)
+ * in the caller.
+ */
+
+template <typename Key, typename Value>
+class NFmiStaleCache
+{
+   public:
+	explicit NFmiStaleCache(int theMaxFailures = 3) : itsMaxFailures(theMaxFailures), itsStopped(false)
+	{
+	}
+
+	~NFmiStaleCache()
+	{
+		{
+			std::lock_guard<std::mutex> lock(itsMutex);
+			itsStopped = true;
+		}
+
+		itsCondition.notify_all();
+
+		if (itsWorker.joinable())
+		{
+			itsWorker.join();
+		}
+	}
+
+	NFmiStaleCache(const NFmiStaleCache&) = delete;
+	NFmiStaleCache& operator=(const NFmiStaleCache&) = delete;
+
+	/*
+	 * theLoad is run by the caller on a miss, theRefresh by the worker thread
+	 * when the value is stale.
+	 */
+
+	Value Get(const Key& theKey, std::chrono::seconds theMaxAge, const std::function<Value()>& theLoad,
+	          const std::function<Value()>& theRefresh)
+	{
+		Value value;
+
+		if (Find(theKey, theMaxAge, theRefresh, value))
+		{
+			return value;
+		}
+
+		value = theLoad();
+		Put(theKey, value);
+
+		return value;
+	}
+
+	/*
+	 * The two halves of Get() for callers that cannot load in place: Find()
+	 * returns false on a miss and queues theRefresh when the value is stale,
+	 * Put() stores a value loaded by the caller.
+	 */
+
+	bool Find(const Key& theKey, std::chrono::seconds theMaxAge, const std::function<Value()>& theRefresh,
+	          Value& theValue)
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+
+		auto it = itsEntries.find(theKey);
+
+		if (it == itsEntries.end())
+		{
+			return false;
+		}
+
+		Entry& entry = it->second;
+
+		if (std::chrono::steady_clock::now() - entry.loaded > theMaxAge && !entry.refreshing && !itsStopped)
+		{
+			entry.refreshing = true;
+			itsQueue.emplace_back(theKey, theRefresh);
+
+			if (!itsWorker.joinable())
+			{
+				itsWorker = std::thread(&NFmiStaleCache::Run, this);
+			}
+
+			itsCondition.notify_one();
+		}
+
+		theValue = entry.value;
+
+		return true;
+	}
+
+	void Put(const Key& theKey, const Value& theValue)
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+
+		Entry& entry = itsEntries[theKey];
+		entry.value = theValue;
+		entry.loaded = std::chrono::steady_clock::now();
+		entry.failures = 0;
+	}
+
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+		itsEntries.clear();
+	}
+
+   private:
+	struct Entry
+	{
+		Value value;
+		std::chrono::steady_clock::time_point loaded;
+		bool refreshing = false;
+		int failures = 0;
+	};
+
+	void Run()
+	{
+		std::unique_lock<std::mutex> lock(itsMutex);
+
+		while (true)
+		{
+			itsCondition.wait(lock, [this]() { return itsStopped || !itsQueue.empty(); });
+
+			if (itsStopped)
+			{
+				return;
+			}
+
+			auto job = std::move(itsQueue.front());
+			itsQueue.pop_front();
+
+			lock.unlock();
+
+			bool ok = false;
+			Value value;
+
+			try
+			{
+				value = job.second();
+				ok = true;
+			}
+			catch (...)
+			{
+			}
+
+			lock.lock();
+
+			auto it = itsEntries.find(job.first);
+
+			if (it == itsEntries.end())
+			{
+				continue;
+			}
+
+			if (ok)
+			{
+				it->second.value = value;
+				it->second.loaded = std::chrono::steady_clock::now();
+				it->second.failures = 0;
+			}
+			else if (++it->second.failures >= itsMaxFailures)
+			{
+				itsEntries.erase(it);
+				continue;
+			}
+
+			it->second.refreshing = false;
+		}
+	}
+
+	const int itsMaxFailures;
+	bool itsStopped;
+
+	std::mutex itsMutex;
+	std::condition_variable itsCondition;
+	std::map<Key, Entry> itsEntries;
+	std::deque<std::pair<Key, std::function<Value()>>> itsQueue;
+	std::thread itsWorker;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*
+ * Uniform grid index over station coordinates (degrees). Stations are
+ * identified by a caller given number, typically the position of the station
+ * in the caller's own catalog.
+ *
+ * Find() returns the stations inside a bounding box (bounds inclusive, as in
+ * SQL BETWEEN) in ascending id order, so that a catalog stored in query order
+ * gives results in that same order.
+ *
+ * Nearest() returns the stations nearest to a point by great circle distance,
+ * using a k-d tree over the stations as points on the unit sphere (so there
+ * are no problems at the date line or near the poles). The tree is built on
+ * the first Nearest() call after stations have been inserted.
+ */
+
+class NFmiStationIndex
+{
+   public:
+	explicit NFmiStationIndex(double theCellSize = 1.0);
+
+	void Insert(size_t theId, double theLatitude, double theLongitude);
+	std::vector<size_t> Find(double theMinLatitude, double theMaxLatitude, double theMinLongitude,
+	                         double theMaxLongitude) const;
+
+	// At most theCount nearest stations as (id, distance in km), nearest first.
+	// With theMaxDistance > 0 only stations within that distance are returned.
+	std::vector<std::pair<size_t, double>> Nearest(double theLatitude, double theLongitude, size_t theCount,
+	                                               double theMaxDistance = 0) const;
+
+	size_t Size() const
+	{
+		return itsSize;
+	}
+	void Clear();
+
+   private:
+	struct Point
+	{
+		size_t id;
+		double latitude;
+		double longitude;
+	};
+
+	struct TreePoint
+	{
+		size_t id;
+		double xyz[3];
+	};
+
+	long Cell(double theCoordinate) const;
+	void BuildTree() const;
+	void BuildTree(size_t theBegin, size_t theEnd) const;
+	void SearchTree(size_t theBegin, size_t theEnd, const double* theXyz, size_t theCount,
+	                std::vector<std::pair<double, size_t>>& theHeap, double& theLimit) const;
+
+	double itsCellSize;
+	size_t itsSize;
+
+	// Range of cells in use, to keep very large boxes cheap
+	long itsMinLatCell;
+	long itsMaxLatCell;
+	long itsMinLonCell;
+	long itsMaxLonCell;
+
+	std::map<std::pair<long, long>, std::vector<Point>> itsCells;
+
+	// k-d tree stored implicitly: the median of each range is its node
+	std::unique_ptr<std::mutex> itsTreeMutex;  // pointer to keep the index movable
+	mutable bool itsTreeBuilt;
+	mutable std::vector<TreePoint> itsTree;
+	mutable std::vector<unsigned char> itsTreeAxis;
+};
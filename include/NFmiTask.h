@@ -0,0 +1,143 @@
+#pragma once
+
+/*
+ * Minimal lazily started coroutine task for the awaitable database lookups.
+ *
+ * Only available when compiled as C++20 with coroutine support; the library
+ * itself is built as C++17, so everything using this must be header-only.
+ *
+ * A task does not run until it is awaited or Start()ed. When a task completes
+ * the coroutine awaiting it is resumed directly, so a lookup that is served
+ * from cache completes without ever suspending.
+ */
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+
+#define FMIDB_HAVE_COROUTINES 1
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+template <typename T>
+class NFmiTask
+{
+   public:
+	struct promise_type
+	{
+		std::optional<T> value;
+		std::exception_ptr error;
+		std::coroutine_handle<> continuation;
+
+		NFmiTask get_return_object()
+		{
+			return NFmiTask(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> theHandle) noexcept
+			{
+				auto continuation = theHandle.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		FinalAwaiter final_suspend() noexcept
+		{
+			return {};
+		}
+		void return_value(T theValue)
+		{
+			value = std::move(theValue);
+		}
+		void unhandled_exception()
+		{
+			error = std::current_exception();
+		}
+	};
+
+	NFmiTask(NFmiTask&& other) noexcept : itsHandle(std::exchange(other.itsHandle, nullptr))
+	{
+	}
+	NFmiTask(const NFmiTask&) = delete;
+	NFmiTask& operator=(const NFmiTask&) = delete;
+	NFmiTask& operator=(NFmiTask&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (itsHandle)
+				itsHandle.destroy();
+			itsHandle = std::exchange(other.itsHandle, nullptr);
+		}
+		return *this;
+	}
+	~NFmiTask()
+	{
+		if (itsHandle)
+			itsHandle.destroy();
+	}
+
+	// Awaiting from another coroutine
+
+	bool await_ready() const noexcept
+	{
+		return !itsHandle || itsHandle.done();
+	}
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> theContinuation) noexcept
+	{
+		itsHandle.promise().continuation = theContinuation;
+		return itsHandle;
+	}
+	T await_resume()
+	{
+		return Get();
+	}
+
+	// Driving from non-coroutine code: Start(), then run the event loop of the
+	// database object (for example NFmiPostgreSQL::WaitAsync()) until Done()
+
+	void Start()
+	{
+		if (itsHandle && !itsHandle.done())
+			itsHandle.resume();
+	}
+	bool Done() const
+	{
+		return itsHandle && itsHandle.done();
+	}
+	T Get()
+	{
+		if (!Done())
+			throw std::logic_error("NFmiTask: result requested before task has completed");
+
+		auto& promise = itsHandle.promise();
+
+		if (promise.error)
+			std::rethrow_exception(promise.error);
+
+		return std::move(*promise.value);
+	}
+
+   private:
+	explicit NFmiTask(std::coroutine_handle<promise_type> theHandle) : itsHandle(theHandle)
+	{
+	}
+
+	std::coroutine_handle<promise_type> itsHandle;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "NFmiCancellationToken.h"
+
+#include <algorithm>
+
+using namespace std;
+
+NFmiCancellationToken::NFmiCancellationToken() : itsCancelled(false), itsHasDeadline(false), itsNextId(0)
+{
+}
+
+NFmiCancellationToken::NFmiCancellationToken(chrono::steady_clock::duration theTimeout)
+    : itsCancelled(false), itsHasDeadline(true), itsDeadline(chrono::steady_clock::now() + theTimeout), itsNextId(0)
+{
+}
+
+/*
+ * Cancel()
+ *
+ * Callbacks are called while holding the lock, so that a connection cannot
+ * unregister (and go away) while it is being cancelled.
+ */
+
+void NFmiCancellationToken::Cancel()
+{
+	itsCancelled = true;
+
+	lock_guard<mutex> lock(itsMutex);
+
+	for (const auto& callback : itsCallbacks)
+	{
+		callback.second();
+	}
+}
+
+bool NFmiCancellationToken::Cancelled() const
+{
+	return itsCancelled || (itsHasDeadline && chrono::steady_clock::now() >= itsDeadline);
+}
+
+int NFmiCancellationToken::Remaining() const
+{
+	if (!itsHasDeadline)
+	{
+		return -1;
+	}
+
+	const auto left = chrono::duration_cast<chrono::milliseconds>(itsDeadline - chrono::steady_clock::now()).count();
+
+	return static_cast<int>(max<long long>(left, 0));
+}
+
+size_t NFmiCancellationToken::Register(function<void()> theCallback)
+{
+	lock_guard<mutex> lock(itsMutex);
+
+	itsCallbacks[itsNextId] = move(theCallback);
+
+	return itsNextId++;
+}
+
+void NFmiCancellationToken::Unregister(size_t theId)
+{
+	lock_guard<mutex> lock(itsMutex);
+
+	itsCallbacks.erase(theId);
+}
@@ -0,0 +1,87 @@
+#include "NFmiDBPoolStatistics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+NFmiDBPoolHistogram::NFmiDBPoolHistogram() : itsCounts(Bounds().size() + 1, 0), itsCount(0), itsSum(0), itsMax(0)
+{
+}
+
+const vector<double>& NFmiDBPoolHistogram::Bounds()
+{
+	static const vector<double> bounds{0.1, 0.25, 0.5, 1,   2.5, 5,    10,   25,
+	                                   50,  100,  250, 500, 1000, 2500, 5000, 10000};
+	return bounds;
+}
+
+void NFmiDBPoolHistogram::Add(chrono::steady_clock::duration theDuration)
+{
+	const double ms = chrono::duration<double, milli>(theDuration).count();
+	const auto& bounds = Bounds();
+
+	itsCounts[lower_bound(bounds.begin(), bounds.end(), ms) - bounds.begin()]++;
+	itsCount++;
+	itsSum += ms;
+	itsMax = max(itsMax, ms);
+}
+
+double NFmiDBPoolHistogram::Mean() const
+{
+	return (itsCount == 0) ? 0 : itsSum / static_cast<double>(itsCount);
+}
+
+double NFmiDBPoolHistogram::Quantile(double theQuantile) const
+{
+	if (itsCount == 0)
+	{
+		return 0;
+	}
+
+	const auto& bounds = Bounds();
+	const double limit = theQuantile * static_cast<double>(itsCount);
+	unsigned long cumulative = 0;
+
+	for (size_t i = 0; i < bounds.size(); i++)
+	{
+		cumulative += itsCounts[i];
+
+		if (static_cast<double>(cumulative) >= limit)
+		{
+			return bounds[i];
+		}
+	}
+
+	return itsMax;
+}
+
+string NFmiDBPoolHistogram::ToString() const
+{
+	stringstream ss;
+
+	ss << "count=" << itsCount << " mean=" << fixed << setprecision(2) << Mean() << "ms p50<=" << Quantile(0.5)
+	   << "ms p95<=" << Quantile(0.95) << "ms p99<=" << Quantile(0.99) << "ms max=" << itsMax << "ms";
+
+	return ss.str();
+}
+
+NFmiDBPoolStatistics::NFmiDBPoolStatistics()
+    : maxWorkers(0), current(0), peak(0), leases(0), exhausted(0), sticky(0), reconnects(0)
+{
+}
+
+string NFmiDBPoolStatistics::ToString() const
+{
+	stringstream ss;
+
+	ss << "workers: max=" << maxWorkers << " current=" << current << " peak=" << peak << "\n"
+	   << "leases: total=" << leases << " exhausted=" << exhausted << " sticky=" << sticky << " reconnects=" << reconnects << "\n"
+	   << "wait: " << waitTime.ToString() << "\n"
+	   << "priority wait: " << priorityWaitTime.ToString() << "\n"
+	   << "hold: " << holdTime.ToString() << "\n"
+	   << "connect: " << connectTime.ToString() << "\n";
+
+	return ss.str();
+}
@@ -0,0 +1,167 @@
+#include "NFmiMovingStationTracks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+/*
+ * ToTime()
+ *
+ * Converts YYYYMMDDHH24MISS (UTC) to time_t.
+ */
+
+time_t NFmiMovingStationTracks::ToTime(const string& theTime)
+{
+	if (theTime.size() < 14)
+	{
+		throw runtime_error("Invalid time: '" + theTime + "'");
+	}
+
+	tm t = {};
+
+	t.tm_year = stoi(theTime.substr(0, 4)) - 1900;
+	t.tm_mon = stoi(theTime.substr(4, 2)) - 1;
+	t.tm_mday = stoi(theTime.substr(6, 2));
+	t.tm_hour = stoi(theTime.substr(8, 2));
+	t.tm_min = stoi(theTime.substr(10, 2));
+	t.tm_sec = stoi(theTime.substr(12, 2));
+
+	return timegm(&t);
+}
+
+void NFmiMovingStationTracks::Add(unsigned long theStation, const string& theName, const string& theCreated,
+                                  double theLatitude, double theLongitude, const string& theElevation,
+                                  bool theWatermark)
+{
+	Position pos;
+	pos.time = ToTime(theCreated);
+	pos.latitude = theLatitude;
+	pos.longitude = theLongitude;
+	pos.elevation = theElevation;
+
+	auto& track = itsTracks[theStation];
+
+	const auto it =
+	    upper_bound(track.begin(), track.end(), pos.time, [](time_t t, const Position& p) { return t < p.time; });
+
+	// Same creation time again replaces the earlier sample
+
+	if (it != track.begin() && (it - 1)->time == pos.time)
+	{
+		*(it - 1) = pos;
+	}
+	else
+	{
+		track.insert(it, pos);
+	}
+
+	itsNames[theStation] = theName;
+
+	if (theWatermark && theCreated.compare(0, 14, itsWatermark) > 0)
+	{
+		itsWatermark = theCreated.substr(0, 14);
+	}
+}
+
+bool NFmiMovingStationTracks::Latest(unsigned long theStation, Position& thePosition) const
+{
+	const auto it = itsTracks.find(theStation);
+
+	if (it == itsTracks.end() || it->second.empty())
+	{
+		return false;
+	}
+
+	thePosition = it->second.back();
+	return true;
+}
+
+bool NFmiMovingStationTracks::At(unsigned long theStation, time_t theTime, Position& thePosition) const
+{
+	const auto it = itsTracks.find(theStation);
+
+	if (it == itsTracks.end() || it->second.empty())
+	{
+		return false;
+	}
+
+	const auto& track = it->second;
+
+	const auto next =
+	    lower_bound(track.begin(), track.end(), theTime, [](const Position& p, time_t t) { return p.time < t; });
+
+	if (next == track.begin())
+	{
+		thePosition = track.front();
+		return true;
+	}
+
+	if (next == track.end())
+	{
+		thePosition = track.back();
+		return true;
+	}
+
+	const Position& a = *(next - 1);
+	const Position& b = *next;
+
+	const double f = static_cast<double>(theTime - a.time) / static_cast<double>(b.time - a.time);
+
+	// Take the shorter way around if the track crosses the date line
+
+	double dlon = b.longitude - a.longitude;
+
+	if (dlon > 180)
+	{
+		dlon -= 360;
+	}
+	else if (dlon < -180)
+	{
+		dlon += 360;
+	}
+
+	thePosition.time = theTime;
+	thePosition.latitude = a.latitude + f * (b.latitude - a.latitude);
+	thePosition.longitude = a.longitude + f * dlon;
+	thePosition.elevation = (f < 0.5 ? a.elevation : b.elevation);
+
+	if (thePosition.longitude > 180)
+	{
+		thePosition.longitude -= 360;
+	}
+	else if (thePosition.longitude < -180)
+	{
+		thePosition.longitude += 360;
+	}
+
+	return true;
+}
+
+string NFmiMovingStationTracks::Name(unsigned long theStation) const
+{
+	const auto it = itsNames.find(theStation);
+
+	return (it == itsNames.end() ? string() : it->second);
+}
+
+void NFmiMovingStationTracks::Prune(time_t theOldest)
+{
+	for (auto& station : itsTracks)
+	{
+		auto& track = station.second;
+
+		auto it = lower_bound(track.begin(), track.end(), theOldest,
+		                      [](const Position& p, time_t t) { return p.time < t; });
+
+		// Keep the latest sample even if it is old
+
+		if (it == track.end() && !track.empty())
+		{
+			--it;
+		}
+
+		track.erase(track.begin(), it);
+	}
+}
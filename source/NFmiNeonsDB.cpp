@@ -11,7 +11,13 @@ NFmiNeonsDB& NFmiNeonsDB::Instance()
 	return instance_;
 }
 
-NFmiNeonsDB::NFmiNeonsDB(short theId) : NFmiOracle(), itsId(theId)
+NFmiNeonsDB::NFmiNeonsDB(short theId)
+    : NFmiOracle(),
+      itsStationIndex(false),
+      itsStationCatalogLoaded(false),
+      itsLatestTimeTTL(0),
+      itsNeonsTablesRefresh(60),
+      itsId(theId)
 {
 	connected_ = false;
 	user_ = "neons_client";
@@ -47,6 +53,19 @@ void NFmiNeonsDB::Connect(const std::string& user, const std::string& password,
 
 string NFmiNeonsDB::GetLatestTime(const std::string& ref_prod, const std::string& geom_name, unsigned int offset)
 {
+	// Served from the cached list of latest times if enabled, fetching a few
+	// extra times so that looping over offsets is one query
+
+	if (itsLatestTimeTTL > 0)
+	{
+		const auto times = GetLatestTimes(ref_prod, max(offset + 1, 10u), geom_name);
+		const auto it = times.find(geom_name);
+
+		if (it == times.end() || it->second.size() <= offset) return "";
+
+		return it->second[offset];
+	}
+
 	// offset 0 suggests that we take the first (there is no offset); that does not
 	// work in Oracle SQL though, there the first result is picked up with offset 1
 
@@ -82,6 +101,86 @@ string NFmiNeonsDB::GetLatestTime(const std::string& ref_prod, const std::string
 	return row[1];
 }
 
+/*
+ * GetLatestTimes()
+ *
+ * One query for the count latest base dates of each geometry, and over all
+ * geometries (key ""), with the same semantics as GetLatestTime() with
+ * offsets 0..count-1. With LatestTimeTTL() > 0 the result is cached for
+ * that many seconds; a cached result for a larger count serves a smaller one.
+ */
+
+map<string, vector<string> > NFmiNeonsDB::GetLatestTimes(const string& ref_prod, unsigned int count,
+                                                         const string& geom_name)
+{
+	const string key = ref_prod + "_" + geom_name;
+	const time_t now = time(nullptr);
+
+	if (itsLatestTimeTTL > 0)
+	{
+		const auto it = latesttimes.find(key);
+
+		if (it != latesttimes.end() && now - it->second.fetched < itsLatestTimeTTL && it->second.count >= count)
+		{
+			FMIDEBUG(cout << "DEBUG: GetLatestTimes() cache hit!" << endl);
+
+			auto ret = it->second.times;
+
+			for (auto& geom : ret)
+			{
+				geom.second.resize(min(geom.second.size(), static_cast<size_t>(count)));
+			}
+
+			return ret;
+		}
+	}
+
+	map<string, vector<string> > ret;
+
+	if (count == 0) return ret;
+
+	string where = "WHERE model_type = '" + ref_prod + "' AND rec_cnt_dset > 0";
+
+	if (!geom_name.empty())
+	{
+		where += " AND geom_name = '" + geom_name + "'";
+	}
+
+	stringstream query;
+
+	query << "SELECT geom_name, base_date FROM ("
+	      << "SELECT geom_name, to_char(base_date,'YYYYMMDDHH24MI') AS base_date, "
+	      << "row_number() OVER (PARTITION BY geom_name ORDER BY base_date DESC) AS rank "
+	      << "FROM as_grid " << where << " GROUP BY geom_name, base_date) "
+	      << "WHERE rank <= " << count << " UNION ALL "
+	      << "SELECT NULL, base_date FROM ("
+	      << "SELECT to_char(base_date,'YYYYMMDDHH24MI') AS base_date, "
+	      << "row_number() OVER (ORDER BY base_date DESC) AS rank "
+	      << "FROM as_grid " << where << " GROUP BY base_date) "
+	      << "WHERE rank <= " << count << " ORDER BY 1 NULLS FIRST, 2 DESC";
+
+	Query(query.str());
+
+	while (true)
+	{
+		vector<string> row = FetchRow();
+
+		if (row.empty()) break;
+
+		ret[row[0]].push_back(row[1]);
+	}
+
+	if (itsLatestTimeTTL > 0)
+	{
+		auto& cached = latesttimes[key];
+		cached.fetched = now;
+		cached.count = count;
+		cached.times = ret;
+	}
+
+	return ret;
+}
+
 map<string, string> NFmiNeonsDB::GetGridDatasetInfo(long centre, long process, const string& geomName,
                                                     const string& baseDate)
 {
@@ -1010,23 +1109,113 @@ map<string, string> NFmiNeonsDB::GetGridModelDefinition(unsigned long producer_i
 vector<string> NFmiNeonsDB::GetNeonsTables(const string& start_time, const string& end_time,
                                            const string& producer_name)
 {
-	vector<string> ret;
+	const string start = NeonsTime(start_time);
+	const string end = NeonsTime(end_time);
+
+	if (start.empty() || end.empty())
+	{
+		// Not a time we can compare in memory, let the database interpret it
+
+		vector<string> ret;
+
+		string query = "SELECT tbl_name FROM as_lltbufr WHERE min_dat <= '" + end_time + "' AND max_dat >= '" +
+		               start_time + "' AND seq_type = '" + producer_name + "'";
+
+		Query(query);
+
+		while (true)
+		{
+			vector<string> row = FetchRow();
+
+			if (row.empty()) break;
+
+			ret.push_back(row[0]);
+		}
+
+		return ret;
+	}
+
+	auto it = neonstables.find(producer_name);
+
+	// New tables can appear inside the known range too and old ones are dropped by rotation
+
+	if (it == neonstables.end() || end > it->second.maxdat ||
+	    time(nullptr) - it->second.loaded >= itsNeonsTablesRefresh)
+	{
+		LoadNeonsTables(producer_name);
+		it = neonstables.find(producer_name);
+	}
+	else
+	{
+		FMIDEBUG(cout << "DEBUG: GetNeonsTables() cache hit!" << endl);
+	}
+
+	return it->second.index.Overlapping(start, end);
+}
+
+/*
+ * LoadNeonsTables(string)
+ *
+ * Reads all as_lltbufr tables of a producer with their time ranges.
+ */
 
-	string query = "SELECT tbl_name FROM as_lltbufr WHERE min_dat <= '" + end_time + "' AND max_dat >= '" + start_time +
-	               "' AND seq_type = '" + producer_name + "'";
+void NFmiNeonsDB::LoadNeonsTables(const string& producer_name)
+{
+	string query = "SELECT tbl_name, min_dat, max_dat FROM as_lltbufr WHERE seq_type = '" + producer_name + "'";
 
 	Query(query);
 
+	NeonsTables tables;
+	tables.loaded = time(nullptr);
+
 	while (true)
 	{
 		vector<string> row = FetchRow();
 
 		if (row.empty()) break;
 
-		ret.push_back(row[0]);
+		const string min_dat = NeonsTime(row[1]);
+		const string max_dat = NeonsTime(row[2]);
+
+		if (min_dat.empty() || max_dat.empty()) continue;
+
+		tables.index.Insert(min_dat, max_dat, row[0]);
+		tables.maxdat = max(tables.maxdat, max_dat);
 	}
 
-	return ret;
+	FMIDEBUG(cout << "DEBUG: " << tables.index.Size() << " tables read for " << producer_name << endl);
+
+	neonstables[producer_name] = move(tables);
+}
+
+/*
+ * NeonsTime(string)
+ *
+ * Time as YYYYMMDDHH24MISS, from any format with the fields in that order
+ * (separators and missing trailing fields are allowed). Empty if the time
+ * does not look like one.
+ */
+
+string NFmiNeonsDB::NeonsTime(const string& theTime)
+{
+	string digits;
+
+	for (char c : theTime)
+	{
+		if (isdigit(static_cast<unsigned char>(c)))
+		{
+			digits += c;
+		}
+	}
+
+	if (digits.size() < 8 || digits.size() > 14)
+	{
+		return "";
+	}
+
+	digits.resize(14, '0');
+
+	return digits;
 }
 
 map<string, string> NFmiNeonsDB::GetGeometryDefinition(size_t ni, size_t nj, double lat, double lon, double di,
@@ -1346,6 +1535,27 @@ map<int, map<string, string> > NFmiNeonsDB::GetStationListForArea(double max_lat
 {
 	map<int, map<string, string> > stationlist;
 
+	if (itsStationIndex)
+	{
+		if (!itsStationCatalogLoaded) LoadStationCatalog();
+
+		// Bounds as they would be written to the query
+
+		const auto ids = stationindex.Find(stod(to_string(min_latitude)), stod(to_string(max_latitude)),
+		                                   stod(to_string(min_longitude)), stod(to_string(max_longitude)));
+
+		for (size_t id : ids)
+		{
+			const auto& values = stationcatalog[id];
+
+			if (temp && values[11] != "1") continue;
+
+			AddStation(values, stationlist);
+		}
+
+		return stationlist;
+	}
+
 	string query =
 	    "SELECT "
 	    "indicatif_omm, "
@@ -1388,40 +1598,120 @@ map<int, map<string, string> > NFmiNeonsDB::GetStationListForArea(double max_lat
 	{
 		vector<string> values = FetchRow();
 
-		map<string, string> station;
+		if (values.empty()) break;
+
+		AddStation(values, stationlist);
+	}
+
+	return stationlist;
+}
+
+/*
+ * AddStation()
+ *
+ * Adds one row of the station list query to the result of
+ * GetStationListForArea().
+ */
+
+void NFmiNeonsDB::AddStation(const vector<string>& values, map<int, map<string, string> >& stationlist)
+{
+	map<string, string> station;
+
+	int wid = std::stoi(values[0]);
+
+	station["indicatif_omm"] = values[0];
+	station["station_name"] = values[4];
+	station["latitude"] = values[5];
+	station["longitude"] = values[6];
+	station["lpnn"] = values[7];
+	station["aws_id"] = values[8];
+	station["country_id"] = values[9];
+	station["elevation"] = values[10];
+
+	stationlist[wid] = station;
+
+	/*
+	 * Fill stationinfo also. This implies that when later on
+	 * GetStationInfo() is called, it will not fetch the station list
+	 * but uses this information.
+	 *
+	 * This should not be a problem since when querying data for an area
+	 * only include stations that are inside that area. This could be a
+	 * problem if in one par we would have an area query and that query
+	 * would contain stations outside the area, but AFAIK that is impossible
+	 * since parfile can only contain EITHER station id OR coordinates, not both.
+	 *
+	 */
+
+	stationinfo[wid] = station;
+}
+
+/*
+ * LoadStationCatalog()
+ *
+ * Reads all stations with a WMO number once, in the order used by
+ * GetStationListForArea(), and builds the spatial index over them. Column 11
+ * tells whether the station is a sounding station, columns 12 and 13 are the
+ * raw lat and lon.
+ */
+
+void NFmiNeonsDB::LoadStationCatalog()
+{
+	const string query =
+	    "SELECT "
+	    "indicatif_omm, "
+	    "indicatif_oaci, "
+	    "indicatif_ship, "
+	    "indicatif_insee, "
+	    "nom_station, "
+	    "lat/100000, "
+	    "lon/100000, "
+	    "lpnn, "
+	    "aws_id, "
+	    "country_id, "
+	    "CASE WHEN elevation_hp IS NOT NULL THEN elevation_hp "
+	    "WHEN elevation_ha IS NOT NULL THEN elevation_ha "
+	    "ELSE NULL END AS elevation, "
+	    "CASE WHEN "
+	    "(OBSALTI00 LIKE '%W%' OR OBSALTI00  LIKE '%P%')"
+	    "OR (OBSALTI06  LIKE '%W%' OR OBSALTI06  LIKE '%P%')"
+	    "OR (OBSALTI12  LIKE '%W%' OR OBSALTI12  LIKE '%P%')"
+	    "OR (OBSALTI18  LIKE '%W%' OR OBSALTI18  LIKE '%P%') "
+	    "THEN 1 ELSE 0 END AS temp, "
+	    "lat, "
+	    "lon "
+	    "FROM "
+	    "station "
+	    "WHERE "
+	    "indicatif_omm IS NOT NULL "
+	    "ORDER BY lat DESC, lon";
+
+	Query(query);
+
+	stationcatalog.clear();
+	stationindex.Clear();
+
+	while (true)
+	{
+		vector<string> values = FetchRow();
 
 		if (values.empty()) break;
 
-		int wid = std::stoi(values[0]);
+		// Stations without coordinates never match a BETWEEN condition. Coordinates
+		// are computed from the raw values: NUMBERs are fetched with 6 significant
+		// digits only, while the query compares lat/100000 exactly
 
-		station["indicatif_omm"] = values[0];
-		station["station_name"] = values[4];
-		station["latitude"] = values[5];
-		station["longitude"] = values[6];
-		station["lpnn"] = values[7];
-		station["aws_id"] = values[8];
-		station["country_id"] = values[9];
-		station["elevation"] = values[10];
-
-		stationlist[wid] = station;
-
-		/*
-		 * Fill stationinfo also. This implies that when later on
-		 * GetStationInfo() is called, it will not fetch the station list
-		 * but uses this information.
-		 *
-		 * This should not be a problem since when querying data for an area
-		 * only include stations that are inside that area. This could be a
-		 * problem if in one par we would have an area query and that query
-		 * would contain stations outside the area, but AFAIK that is impossible
-		 * since parfile can only contain EITHER station id OR coordinates, not both.
-		 *
-		 */
+		if (!values[12].empty() && !values[13].empty())
+		{
+			stationindex.Insert(stationcatalog.size(), stod(values[12]) / 100000, stod(values[13]) / 100000);
+		}
 
-		stationinfo[wid] = station;
+		stationcatalog.push_back(values);
 	}
 
-	return stationlist;
+	itsStationCatalogLoaded = true;
+
+	FMIDEBUG(cout << "DEBUG: Station catalog has " << stationcatalog.size() << " stations" << endl);
 }
 
 void NFmiNeonsDB::SQLDateMask(const std::string& theDateMask)
@@ -1454,6 +1744,8 @@ NFmiNeonsDBPool::NFmiNeonsDBPool()
     : itsMaxWorkers(2),
       itsWorkingList(itsMaxWorkers, -1),
       itsWorkerList(itsMaxWorkers, NULL),
+      itsServerAttachments(0),
+      itsLeaseTime(itsMaxWorkers),
       itsExternalAuthentication(false),
       itsReadWriteTransaction(false),
       itsUsername(""),
@@ -1464,13 +1756,41 @@ NFmiNeonsDBPool::NFmiNeonsDBPool()
 
 NFmiNeonsDBPool::~NFmiNeonsDBPool()
 {
+	FMIDEBUG(cout << "DEBUG: NFmiNeonsDBPool statistics:\n" << Statistics().ToString());
+
+	// Workers must let go of shared attachments before they are detached
+
 	for (unsigned int i = 0; i < itsWorkerList.size(); i++)
 	{
+		if (!itsWorkerList[i]) continue;
+
 		itsWorkerList[i]->Detach();
 		delete itsWorkerList[i];
 	}
+
+	for (unsigned int i = 0; i < itsServerList.size(); i++)
+	{
+		if (!itsServerList[i]) continue;
+
+		itsServerList[i]->Detach();
+		delete itsServerList[i];
+	}
+
+	for (auto server : itsRetiredServerList)
+	{
+		try
+		{
+			server->Detach();
+			delete server;
+		}
+		catch (...)
+		{
+		}
+	}
+
 	itsWorkerList.clear();
 	itsWorkingList.clear();
+	itsServerList.clear();
 	delete itsInstance;
 }
 /*
@@ -1489,20 +1809,30 @@ NFmiNeonsDB* NFmiNeonsDBPool::GetConnection()
 	 *  1 --> active
 	 *  0 --> inactive
 	 * -1 --> uninitialized
+	 * -2 --> lost its shared attachment, to be re-created
 	 *
 	 * Logic of returning connections:
 	 *
+	 * 0. Reset workers whose shared attachment is lost or has been replaced.
 	 * 1. Check if worker is idle, if so return that worker.
 	 * 2. Check if worker is uninitialized, if so create worker and return that.
 	 * 3. Sleep and start over
 	 */
 
+	const auto start = chrono::steady_clock::now();
+	bool waited = false;
+
 	lock_guard<mutex> lock(itsGetMutex);
 
 	while (true)
 	{
 		for (unsigned int i = 0; i < itsWorkingList.size(); i++)
 		{
+			if (itsWorkingList[i] == -2 || (itsWorkingList[i] == 0 && StaleAttachment(i)))
+			{
+				ResetWorker(i);
+			}
+
 			// Return connection that has been initialized but is idle
 			if (itsWorkingList[i] == 0)
 			{
@@ -1513,6 +1843,8 @@ NFmiNeonsDB* NFmiNeonsDBPool::GetConnection()
 
 				FMIDEBUG(cout << "DEBUG: Worker returned with id " << itsWorkerList[i]->Id() << endl);
 
+				Leased(i, start, waited);
+
 				return itsWorkerList[i];
 			}
 			else if (itsWorkingList[i] == -1)
@@ -1540,13 +1872,24 @@ NFmiNeonsDB* NFmiNeonsDBPool::GetConnection()
 					}
 
 					itsWorkerList[i]->Verbose(true);
-					itsWorkerList[i]->Attach();
+
+					const auto connectStart = chrono::steady_clock::now();
+
+					AttachWorker(i);
+
+					{
+						lock_guard<mutex> statLock(itsStatisticsMutex);
+						itsStatistics.connectTime.Add(chrono::steady_clock::now() - connectStart);
+					}
+
 					itsWorkerList[i]->SQLDateMask("YYYYMMDDHH24MISS");
 
 					itsWorkingList[i] = 1;
 
 					FMIDEBUG(cout << "DEBUG: Worker returned with id " << itsWorkerList[i]->Id() << endl);
 
+					Leased(i, start, waited);
+
 					return itsWorkerList[i];
 				}
 				catch (int e)
@@ -1561,12 +1904,158 @@ NFmiNeonsDB* NFmiNeonsDBPool::GetConnection()
 		cout << "DEBUG: Waiting for worker release" << endl;
 #endif
 
+		waited = true;
 		usleep(100000);  // 100 ms
 	}
 
 	throw runtime_error("Impossible error at NFmiNeonsDBPool::GetConnection()");
 }
 
+/*
+ * AttachWorker()
+ *
+ * Attaches worker to Neons, either with an attachment of its own or by
+ * sharing one of the pool's server attachments. Shared attachments are
+ * created on demand.
+ */
+
+void NFmiNeonsDBPool::AttachWorker(size_t theWorker)
+{
+	if (itsServerAttachments == 0)
+	{
+		itsWorkerList[theWorker]->Attach();
+		return;
+	}
+
+	NFmiNeonsDB*& server = itsServerList[theWorker % itsServerAttachments];
+
+	if (!server)
+	{
+		server = new NFmiNeonsDB(static_cast<short>(theWorker % itsServerAttachments));
+
+		if (itsDatabase != "")
+		{
+			server->database_ = itsDatabase;
+		}
+
+		try
+		{
+			server->Attach();
+		}
+		catch (...)
+		{
+			delete server;
+			server = NULL;
+			throw;
+		}
+
+		FMIDEBUG(cout << "DEBUG: Created shared attachment " << server->Id() << endl);
+	}
+
+	itsWorkerList[theWorker]->Attach(*server);
+}
+
+/*
+ * StaleAttachment()
+ *
+ * True if worker shares a server attachment that has since been replaced.
+ */
+
+bool NFmiNeonsDBPool::StaleAttachment(size_t theWorker) const
+{
+	if (itsServerAttachments == 0)
+	{
+		return false;
+	}
+
+	return itsWorkerList[theWorker]->server_ != itsServerList[theWorker % itsServerAttachments];
+}
+
+/*
+ * ResetWorker()
+ *
+ * Drops a worker whose shared attachment has lost its server connection.
+ * The attachment is retired so that the next lease attaches a new one, and
+ * deleted once no worker refers to it any more. Errors are ignored: the
+ * connection is gone already.
+ */
+
+void NFmiNeonsDBPool::ResetWorker(size_t theWorker)
+{
+	NFmiNeonsDB* worker = itsWorkerList[theWorker];
+	NFmiOracle* server = worker->server_;
+
+	// Session went with the connection, only local handles are released
+
+	try
+	{
+		worker->db_.logoff();
+	}
+	catch (...)
+	{
+	}
+
+	worker->initialized_ = false;
+	worker->Detach();
+	delete worker;
+
+	itsWorkerList[theWorker] = NULL;
+	itsWorkingList[theWorker] = -1;
+
+	FMIDEBUG(cout << "DEBUG: Worker " << theWorker << " reset after lost attachment" << endl);
+
+	NFmiNeonsDB*& current = itsServerList[theWorker % itsServerAttachments];
+
+	if (server && server == current)
+	{
+		itsRetiredServerList.push_back(current);
+		current = NULL;
+
+		lock_guard<mutex> statLock(itsStatisticsMutex);
+		itsStatistics.reconnects++;
+	}
+
+	for (auto it = itsRetiredServerList.begin(); it != itsRetiredServerList.end();)
+	{
+		const bool used = any_of(itsWorkerList.begin(), itsWorkerList.end(),
+		                         [&](NFmiNeonsDB* w) { return w && w->server_ == *it; });
+
+		if (used)
+		{
+			++it;
+			continue;
+		}
+
+		try
+		{
+			(*it)->Detach();
+			delete *it;
+		}
+		catch (...)
+		{
+		}
+
+		it = itsRetiredServerList.erase(it);
+	}
+}
+
+void NFmiNeonsDBPool::Leased(size_t theWorker, const chrono::steady_clock::time_point& theStart, bool theWaited)
+{
+	itsLeaseTime[theWorker] = chrono::steady_clock::now();
+
+	lock_guard<mutex> lock(itsStatisticsMutex);
+
+	itsStatistics.waitTime.Add(itsLeaseTime[theWorker] - theStart);
+	itsStatistics.leases++;
+	itsStatistics.current++;
+	itsStatistics.peak = max(itsStatistics.peak, itsStatistics.current);
+
+	if (theWaited)
+	{
+		itsStatistics.exhausted++;
+	}
+}
+
 /*
  * Release()
  *
@@ -1578,9 +2067,32 @@ void NFmiNeonsDBPool::Release(NFmiNeonsDB* theWorker)
 {
 	lock_guard<mutex> lock(itsReleaseMutex);
 
-	theWorker->Rollback();
-	theWorker->EndSession();
-	itsWorkingList[theWorker->Id()] = 0;
+	try
+	{
+		theWorker->Rollback();
+		theWorker->EndSession();
+	}
+	catch (int)
+	{
+		if (!theWorker->ConnectionLost() || itsServerAttachments == 0)
+		{
+			throw;
+		}
+	}
+
+	{
+		lock_guard<mutex> statLock(itsStatisticsMutex);
+
+		itsStatistics.holdTime.Add(chrono::steady_clock::now() - itsLeaseTime[theWorker->Id()]);
+		itsStatistics.current--;
+		itsStatistics.reconnects += theWorker->reconnects_;
+
+		theWorker->reconnects_ = 0;
+	}
+
+	// A worker on a shared attachment cannot reconnect by itself, the next lease re-creates it
+
+	itsWorkingList[theWorker->Id()] = (theWorker->ConnectionLost() && itsServerAttachments > 0) ? -2 : 0;
 
 	FMIDEBUG(cout << "DEBUG: Worker released for id " << theWorker->Id() << endl);
 }
@@ -1600,4 +2112,45 @@ void NFmiNeonsDBPool::MaxWorkers(int theMaxWorkers)
 
 	itsWorkingList.resize(itsMaxWorkers, -1);
 	itsWorkerList.resize(itsMaxWorkers, NULL);
+	itsLeaseTime.resize(itsMaxWorkers);
+}
+
+void NFmiNeonsDBPool::ServerAttachments(int theAttachments)
+{
+	lock_guard<mutex> lock(itsGetMutex);
+
+	if (theAttachments == itsServerAttachments) return;
+
+	if (theAttachments < 0)
+		throw runtime_error("Number of server attachments cannot be negative");
+
+	for (size_t i = 0; i < itsWorkingList.size(); i++)
+	{
+		if (itsWorkingList[i] != -1)
+			throw runtime_error("Server attachments must be set before first connection is made");
+	}
+
+	itsServerAttachments = theAttachments;
+	itsServerList.resize(itsServerAttachments, NULL);
+}
+
+NFmiDBPoolStatistics NFmiNeonsDBPool::Statistics()
+{
+	lock_guard<mutex> lock(itsStatisticsMutex);
+
+	NFmiDBPoolStatistics ret = itsStatistics;
+	ret.maxWorkers = itsMaxWorkers;
+
+	return ret;
+}
+
+void NFmiNeonsDBPool::ResetStatistics()
+{
+	lock_guard<mutex> lock(itsStatisticsMutex);
+
+	const int current = itsStatistics.current;
+
+	itsStatistics = NFmiDBPoolStatistics();
+	itsStatistics.current = current;
+	itsStatistics.peak = current;
 }
@@ -27,7 +27,21 @@ NFmiOracle& NFmiOracle::Instance()
 }
 
 NFmiOracle::NFmiOracle()
-    : test_mode_(false), verbose_(false), initialized_(false), pooled_connection_(false), credentials_set_(false){};
+    : test_mode_(false),
+      verbose_(false),
+      initialized_(false),
+      pooled_connection_(false),
+      credentials_set_(false),
+      reconnects_(0),
+      connection_lost_(false),
+      server_(nullptr),
+      svchp_(nullptr),
+      authp_(nullptr),
+      errhp_(nullptr),
+      call_timeout_(0),
+      applied_timeout_(0),
+      token_(nullptr),
+      token_id_(0){};
 
 void NFmiOracle::Connect(const string& user, const string& password, const string& database, const int threadedMode)
 {
@@ -97,6 +111,8 @@ void NFmiOracle::Query(const string& sql, const unsigned int buffer_size)
 	if (TestMode())
 		return;
 
+	PrepareCall();
+
 	FMIDEBUG(cout << "DEBUG: " << sql.c_str() << endl);
 
 	try
@@ -122,6 +138,8 @@ void NFmiOracle::Query(const string& sql, const unsigned int buffer_size)
 			cerr << "Query: " << p.stm_text << endl;
 		}
 
+		ResetCall(p.code);
+		NoteError(p.code);
 		throw p.code;
 	}
 }
@@ -404,6 +422,33 @@ vector<string> NFmiOracle::FetchRowFromCursor()
 	return ret;
 }
 
+/*
+ * FetchRowsFromCursor()
+ *
+ * Block fetch from ref cursor. Rows are read from the stream buffer, which
+ * is filled from server buffer_size rows at a time (see ExecuteProcedure()).
+ */
+
+vector<vector<string>> NFmiOracle::FetchRowsFromCursor(size_t theMaxRows)
+{
+	vector<vector<string>> ret;
+	ret.reserve(min<size_t>(theMaxRows, 1000));
+
+	while (ret.size() < theMaxRows)
+	{
+		auto row = FetchRowFromCursor();
+
+		if (row.empty())
+		{
+			break;
+		}
+
+		ret.push_back(move(row));
+	}
+
+	return ret;
+}
+
 /*
  * Execute(string)
  *
@@ -420,6 +465,7 @@ void NFmiOracle::Execute(const string& sql)
 	}
 
 	BeginSession();
+	PrepareCall();
 
 	FMIDEBUG(cout << "DEBUG: " << sql.c_str() << endl);
 
@@ -435,6 +481,9 @@ void NFmiOracle::Execute(const string& sql)
 			cerr << "Query: " << p.stm_text << endl;
 		}
 
+		ResetCall(p.code);
+		NoteError(p.code);
+
 		// re-throw error code
 		throw p.code;
 	}
@@ -448,6 +497,11 @@ void NFmiOracle::Execute(const string& sql)
  */
 
 void NFmiOracle::ExecuteProcedure(const string& sql)
+{
+	return ExecuteProcedure(sql, 50);
+}
+
+void NFmiOracle::ExecuteProcedure(const string& sql, const unsigned int buffer_size)
 {
 	if (!connected_)
 	{
@@ -460,7 +514,11 @@ void NFmiOracle::ExecuteProcedure(const string& sql)
 	if (TestMode())
 		return;
 
-	string temp_sql = "BEGIN\n:cur<refcur,out> := " + sql + ";\nEND;";
+	PrepareCall();
+
+	// Array size of the ref cursor is given in the bind variable declaration
+
+	string temp_sql = "BEGIN\n:cur<refcur,out[" + to_string(max(buffer_size, 1u)) + "]> := " + sql + ";\nEND;";
 
 	FMIDEBUG(cout << "DEBUG: " << temp_sql.c_str() << endl);
 
@@ -489,6 +547,8 @@ void NFmiOracle::ExecuteProcedure(const string& sql)
 			cerr << "Query: " << p.stm_text << endl;
 		}
 
+		ResetCall(p.code);
+		NoteError(p.code);
 		throw p.code;
 	}
 }
@@ -505,6 +565,14 @@ NFmiOracle::~NFmiOracle() noexcept
 }
 void NFmiOracle::Disconnect()
 {
+	CancellationToken(nullptr);
+
+	if (server_)
+	{
+		Detach();
+		return;
+	}
+
 	db_.logoff();  // disconnect from NFmiOracle
 	connected_ = false;
 	initialized_ = false;
@@ -544,6 +612,7 @@ void NFmiOracle::Commit()
 		// Always print error if commit fails
 
 		cerr << p.msg << endl;
+		NoteError(p.code);
 		throw p.code;
 	}
 }
@@ -573,6 +642,7 @@ void NFmiOracle::Rollback()
 		// Always print error if rollback fails (it should be impossible though)
 
 		cerr << p.msg;
+		NoteError(p.code);
 		throw p.code;
 	}
 }
@@ -632,6 +702,19 @@ void NFmiOracle::Detach()
 	if (!connected_)
 		return;
 
+	if (server_)
+	{
+		// Only our own session is closed, the server attachment belongs to someone else
+
+		EndSession();
+		FreeSharedHandles();
+
+		connected_ = false;
+
+		FMIDEBUG(cout << "DEBUG: released shared attachment to Oracle " << database_ << endl);
+		return;
+	}
+
 	try
 	{
 		db_.server_detach();
@@ -648,6 +731,195 @@ void NFmiOracle::Detach()
 	}
 }
 
+void NFmiOracle::Attach(NFmiOracle& theServer)
+{
+	if (connected_)
+		return;
+
+	if (!theServer.connected_)
+		throw runtime_error("Server connection must be attached before it can be shared");
+
+	auto& server = theServer.db_.get_connect_struct();
+	OCIEnv* envhp = server.get_envhp();
+
+	if (OCIHandleAlloc(envhp, reinterpret_cast<void**>(&errhp_), OCI_HTYPE_ERROR, 0, nullptr) != OCI_SUCCESS)
+		throw runtime_error("Unable to allocate OCI error handle");
+
+	server_ = &theServer;
+
+	try
+	{
+		CheckOCI(OCIHandleAlloc(envhp, reinterpret_cast<void**>(&svchp_), OCI_HTYPE_SVCCTX, 0, nullptr),
+		         "allocate service context");
+		CheckOCI(OCIHandleAlloc(envhp, reinterpret_cast<void**>(&authp_), OCI_HTYPE_SESSION, 0, nullptr),
+		         "allocate session handle");
+		CheckOCI(OCIAttrSet(svchp_, OCI_HTYPE_SVCCTX, server.get_srvhp(), 0, OCI_ATTR_SERVER, errhp_),
+		         "set server attachment");
+	}
+	catch (...)
+	{
+		FreeSharedHandles();
+		throw;
+	}
+
+	connected_ = true;
+
+	FMIDEBUG(cout << "DEBUG: sharing attachment to Oracle " << database_ << endl);
+}
+
+OCISvcCtx* NFmiOracle::ServiceContext()
+{
+	return server_ ? svchp_ : db_.get_connect_struct().get_svchp();
+}
+
+OCIError* NFmiOracle::ErrorHandle()
+{
+	return server_ ? errhp_ : db_.get_connect_struct().get_errhp();
+}
+
+/*
+ * PrepareCall()
+ *
+ * Checks the cancellation token and sets the call timeout of the service
+ * context before a call to server. Setting the attribute is a local
+ * operation and does not cost a round trip.
+ */
+
+void NFmiOracle::PrepareCall()
+{
+	int timeout = call_timeout_;
+
+	if (token_)
+	{
+		if (token_->Cancelled())
+		{
+			throw runtime_error("NFmiOracle: call cancelled");
+		}
+
+		const int remaining = token_->Remaining();
+
+		if (remaining >= 0 && (timeout == 0 || remaining < timeout))
+		{
+			timeout = max(remaining, 1);
+		}
+	}
+
+	if (timeout == 0 && applied_timeout_ == 0)
+	{
+		return;
+	}
+
+	OCISvcCtx* svchp = ServiceContext();
+
+	if (!svchp)
+	{
+		return;
+	}
+
+	ub4 value = static_cast<ub4>(timeout);
+
+	CheckOCI(OCIAttrSet(svchp, OCI_HTYPE_SVCCTX, &value, 0, OCI_ATTR_CALL_TIMEOUT, ErrorHandle()),
+	         "set call timeout");
+
+	applied_timeout_ = timeout;
+}
+
+/*
+ * ResetCall()
+ *
+ * After a call has been interrupted with OCIBreak() the connection must be
+ * reset before it can be used again.
+ */
+
+void NFmiOracle::ResetCall(int theCode)
+{
+	if (theCode != 1013)
+	{
+		return;
+	}
+
+	FMIDEBUG(cout << "DEBUG: call cancelled, resetting connection" << endl);
+
+	OCIReset(ServiceContext(), ErrorHandle());
+}
+
+void NFmiOracle::CancellationToken(NFmiCancellationToken* theToken)
+{
+	if (token_)
+	{
+		token_->Unregister(token_id_);
+	}
+
+	token_ = theToken;
+
+	if (token_)
+	{
+		token_id_ = token_->Register(
+		    [this]()
+		    {
+			    if (connected_ && !server_)
+			    {
+				    FMIDEBUG(cout << "DEBUG: breaking running call" << endl);
+				    db_.cancel();
+			    }
+		    });
+	}
+}
+
+void NFmiOracle::CheckOCI(int theStatus, const string& theWhat)
+{
+	if (theStatus == OCI_SUCCESS || theStatus == OCI_SUCCESS_WITH_INFO)
+		return;
+
+	sb4 code = 0;
+	text msg[512] = {0};
+
+	OCIErrorGet(ErrorHandle(), 1, nullptr, &code, msg, sizeof(msg), OCI_HTYPE_ERROR);
+
+	cerr << "Unable to " << theWhat << endl;
+	cerr << reinterpret_cast<char*>(msg) << endl;
+
+	NoteError(code);
+
+	throw static_cast<int>(code);
+}
+
+/*
+ * NoteError()
+ *
+ * Remembers if an error means that the server connection is gone, so that
+ * a pool can replace a shared attachment that no call can succeed on.
+ */
+
+void NFmiOracle::NoteError(int theCode)
+{
+	switch (theCode)
+	{
+		case 3113:  // end-of-file on communication channel
+		case 3114:  // not connected to ORACLE
+		case 3135:  // connection lost contact
+			connection_lost_ = true;
+			break;
+		default:
+			break;
+	}
+}
+
+void NFmiOracle::FreeSharedHandles()
+{
+	if (authp_)
+		OCIHandleFree(authp_, OCI_HTYPE_SESSION);
+	if (svchp_)
+		OCIHandleFree(svchp_, OCI_HTYPE_SVCCTX);
+	if (errhp_)
+		OCIHandleFree(errhp_, OCI_HTYPE_ERROR);
+
+	authp_ = nullptr;
+	svchp_ = nullptr;
+	errhp_ = nullptr;
+	server_ = nullptr;
+}
+
 void NFmiOracle::BeginSession()
 {
 	if (!connected_)
@@ -660,7 +932,31 @@ void NFmiOracle::BeginSession()
 
 	try
 	{
-		if (credentials_set_)
+		if (server_)
+		{
+			// Lightweight session on a shared server attachment. Empty user name
+			// means external authentication, like with otl_connect::session_begin().
+
+			ub4 credentials = OCI_CRED_EXT;
+
+			if (!user_.empty())
+			{
+				CheckOCI(OCIAttrSet(authp_, OCI_HTYPE_SESSION, const_cast<char*>(user_.c_str()),
+				                    static_cast<ub4>(user_.size()), OCI_ATTR_USERNAME, errhp_),
+				         "set session user name");
+				CheckOCI(OCIAttrSet(authp_, OCI_HTYPE_SESSION, const_cast<char*>(password_.c_str()),
+				                    static_cast<ub4>(password_.size()), OCI_ATTR_PASSWORD, errhp_),
+				         "set session password");
+				credentials = OCI_CRED_RDBMS;
+			}
+
+			CheckOCI(OCISessionBegin(svchp_, errhp_, authp_, credentials, OCI_DEFAULT), "begin session");
+			CheckOCI(OCIAttrSet(svchp_, OCI_HTYPE_SVCCTX, authp_, 0, OCI_ATTR_SESSION, errhp_),
+			         "set session to service context");
+
+			db_.rlogon(server_->db_.get_connect_struct().get_envhp(), svchp_);
+		}
+		else if (credentials_set_)
 		{
 			db_.session_reopen();
 		}
@@ -684,7 +980,16 @@ void NFmiOracle::BeginSession()
 		switch (p.code)
 		{
 			case 3135:
+				if (server_)
+				{
+					// Shared attachment is owned by the pool, it cannot be reconnected from here
+					cerr << "Got ORA-03135: shared attachment lost contact\n";
+					NoteError(p.code);
+					throw(p.code);
+				}
+
 				cerr << "Got ORA-03135: connection lost contact, reconnecting ...\n";
+				reconnects_++;
 				Detach();
 				Attach();
 				// Should we have a counter here? This might turn into an eternal loop ...
@@ -694,6 +999,7 @@ void NFmiOracle::BeginSession()
 			default:
 				cerr << "Unable to begin session as user " << user_ << endl;
 				cerr << p.msg << endl;  // print out error message
+				NoteError(p.code);
 				throw(p.code);
 				break;
 		}
@@ -712,7 +1018,16 @@ void NFmiOracle::EndSession()
 
 	try
 	{
-		db_.session_end();
+		if (server_)
+		{
+			db_.logoff();  // releases the service context from OTL, does not end the session
+			CheckOCI(OCISessionEnd(svchp_, errhp_, authp_, OCI_DEFAULT), "end session");
+		}
+		else
+		{
+			db_.session_end();
+		}
+
 		initialized_ = false;
 
 		FMIDEBUG(cout << "DEBUG: session ended" << endl);
@@ -721,6 +1036,7 @@ void NFmiOracle::EndSession()
 	{
 		cerr << "Unable to end session" << endl;
 		cerr << p.msg << endl;  // print out error message
+		NoteError(p.code);
 		throw p.code;
 		// exit(1);
 	}
@@ -11,7 +11,8 @@ NFmiPGCLDB& NFmiPGCLDB::Instance()
 	return instance_;
 }
 
-NFmiPGCLDB::NFmiPGCLDB(short theId) : NFmiPostgreSQL(), itsId(theId)
+NFmiPGCLDB::NFmiPGCLDB(short theId)
+    : NFmiPostgreSQL(), itsStationCatalog(false), itsMovingTracksRefreshed(0), itsMovingTrackHours(72), itsId(theId)
 {
 }
 
@@ -316,6 +317,12 @@ map<string, string> NFmiPGCLDB::GetExtSynopStationInfo(unsigned long station_id,
 map<string, string> NFmiPGCLDB::GetFMIStationInfo(unsigned long producer_id, unsigned long station_id,
                                                 bool aggressive_cache)
 {
+	if (producer_id == 20022)
+	{
+		// icebuoy, position changes so it is not cached here
+		return GetMovingStationInfo(station_id);
+	}
+
 	string producer_id_str = to_string(producer_id);
 	string key = producer_id_str + (to_string(station_id).length() == 4 ? "_0" + to_string(station_id) : "_" + to_string(station_id));
 
@@ -565,6 +572,67 @@ map<int, map<string, string>> NFmiPGCLDB::GetStationListForArea(unsigned long pr
                                                               double min_longitude)
 {
 	map<int, map<string, string>> stationlist;
+
+	if (itsStationCatalog)
+	{
+		if (stationcatalog.find(producer_id) == stationcatalog.end()) LoadStationCatalog(producer_id);
+
+		const auto& catalog = stationcatalog[producer_id];
+
+		// Bounds as they would be written to the query
+
+		const auto ids = stationindex[producer_id].Find(stod(to_string(min_latitude)), stod(to_string(max_latitude)),
+		                                                stod(to_string(min_longitude)), stod(to_string(max_longitude)));
+
+		for (size_t i : ids)
+		{
+			stationlist[catalog[i].first] = catalog[i].second;
+		}
+
+		return stationlist;
+	}
+
+	Query(StationListQuery(producer_id, max_latitude, min_latitude, max_longitude, min_longitude));
+
+	while (true)
+	{
+		vector<string> values = FetchRow();
+
+		if (values.empty()) break;
+
+		const auto station = StationListRow(values);
+		const int id = std::stoi(values[0]);
+
+		stationlist[id] = station;
+
+		/*
+		 * Fill stationinfo also. This implies that when later on
+		 * GetStationInfo() is called, it will not fetch the station list
+		 * but uses this information.
+		 *
+		 * This should not be a problem since when querying data for an area
+		 * only include stations that are inside that area. This could be a
+		 * problem if in one par we would have an area query and that query
+		 * would contain stations outside the area, but AFAIK that is impossible
+		 * since parfile can only contain EITHER station id OR coordinates, not both.
+		 *
+		 */
+
+		CacheStationInfo(producer_id, id, station);
+	}
+
+	return stationlist;
+}
+
+/*
+ * StationListQuery()
+ *
+ * Producer specific station query of GetStationListForArea().
+ */
+
+string NFmiPGCLDB::StationListQuery(unsigned long producer_id, double max_latitude, double min_latitude,
+                                 double max_longitude, double min_longitude)
+{
 	string query;
 
 	switch (producer_id)
@@ -802,56 +870,182 @@ map<int, map<string, string>> NFmiPGCLDB::GetStationListForArea(unsigned long pr
 			break;
 	}
 
-	Query(query);
+	return query;
+}
+
+map<string, string> NFmiPGCLDB::StationListRow(const vector<string>& values)
+{
+	map<string, string> station;
+
+	station["station_id"] = values[0];
+	station["latitude"] = values[1];
+	station["longitude"] = values[2];
+	station["station_name"] = values[3];
+	station["fmisid"] = values[4];
+	station["lpnn"] = values[5];
+	station["elevation"] = values[6];
+
+	return station;
+}
+
+void NFmiPGCLDB::CacheStationInfo(unsigned long producer_id, int id, const map<string, string>& station)
+{
+	switch (producer_id)
+	{
+		case 20013:
+			road_weather_stations[id] = station;
+			break;
+
+		case 20014:
+			swedish_road_weather_stations[id] = station;
+			break;
+
+		default:
+			fmi_stations[to_string(producer_id) + "_" + to_string(id)] = station;
+			break;
+	}
+}
+
+/*
+ * LoadStationCatalog()
+ *
+ * Reads all stations of a producer with the area query (with bounds covering
+ * everything) and builds the spatial index over them. The stations are also
+ * placed in the GetStationInfo() caches, as the area query does.
+ */
+
+void NFmiPGCLDB::LoadStationCatalog(unsigned long producer_id)
+{
+	Query(StationListQuery(producer_id, 1000, -1000, 1000, -1000));
+
+	vector<pair<int, map<string, string>>> catalog;
+	NFmiStationIndex index;
 
 	while (true)
 	{
 		vector<string> values = FetchRow();
-		map<string, string> station;
 
 		if (values.empty()) break;
 
-		int id = std::stoi(values[0]);
+		const auto station = StationListRow(values);
+		const int id = std::stoi(values[0]);
 
-		station["station_id"] = values[0];
-		station["latitude"] = values[1];
-		station["longitude"] = values[2];
-		station["station_name"] = values[3];
-		station["fmisid"] = values[4];
-		station["lpnn"] = values[5];
-		station["elevation"] = values[6];
+		if (!values[1].empty() && !values[2].empty())
+		{
+			index.Insert(catalog.size(), stod(values[1]), stod(values[2]));
+		}
 
-		stationlist[id] = station;
+		catalog.push_back(make_pair(id, station));
 
-		/*
-		 * Fill stationinfo also. This implies that when later on
-		 * GetStationInfo() is called, it will not fetch the station list
-		 * but uses this information.
-		 *
-		 * This should not be a problem since when querying data for an area
-		 * only include stations that are inside that area. This could be a
-		 * problem if in one par we would have an area query and that query
-		 * would contain stations outside the area, but AFAIK that is impossible
-		 * since parfile can only contain EITHER station id OR coordinates, not both.
-		 *
-		 */
+		CacheStationInfo(producer_id, id, station);
+	}
+
+	FMIDEBUG(cout << "DEBUG: Station catalog for producer " << producer_id << " has " << catalog.size()
+	              << " stations" << endl);
+
+	stationcatalog[producer_id] = move(catalog);
+	stationindex[producer_id] = move(index);
+}
+
+/*
+ * GetMovingStationInfo(unsigned long, const string&)
+ *
+ * Station information of a moving station (icebuoy), with position at the
+ * given time (YYYYMMDDHH24MISS) interpolated from the position history, or
+ * the latest position if time is empty.
+ *
+ * Recent positions of all moving stations are read with one query and
+ * refreshed incrementally with the positions created after the newest one
+ * already read. A station without recent positions is read individually.
+ */
+
+map<string, string> NFmiPGCLDB::GetMovingStationInfo(unsigned long station_id, const string& theTime)
+{
+	RefreshMovingTracks();
+
+	NFmiMovingStationTracks::Position pos;
 
-		switch (producer_id)
+	if (!movingtracks.Latest(station_id, pos))
+	{
+		if (unknown_moving_stations.count(station_id)) return map<string, string>();
+
+		Query(
+		    "SELECT m.station_id, s.station_name, to_char(m.created, 'YYYYMMDDHH24MISS'), m.lat, m.lon, m.elev "
+		    "FROM stations_v1 s JOIN moving_locations_v1 m ON m.station_id = s.station_id "
+		    "WHERE m.created = (select max(created) from moving_locations_v1 where station_id = " +
+		    to_string(station_id) + ") AND s.station_id = " + to_string(station_id));
+
+		AddMovingRows(false);
+
+		if (!movingtracks.Latest(station_id, pos))
 		{
-			case 20013:
-				road_weather_stations[id] = station;
-				break;
-
-			case 20014:
-				swedish_road_weather_stations[id] = station;
-				break;
-
-			default:
-				fmi_stations[to_string(producer_id) + "_" + to_string(id)] =
-				    station;
-				break;
+			unknown_moving_stations.insert(station_id);
+			return map<string, string>();
 		}
 	}
 
-	return stationlist;
+	if (!theTime.empty())
+	{
+		movingtracks.At(station_id, NFmiMovingStationTracks::ToTime(theTime), pos);
+	}
+
+	stringstream lat, lon;
+	lat << setprecision(10) << pos.latitude;
+	lon << setprecision(10) << pos.longitude;
+
+	map<string, string> station;
+
+	station["wmon"] = "";
+	station["latitude"] = lat.str();
+	station["longitude"] = lon.str();
+	station["station_name"] = movingtracks.Name(station_id);
+	station["fmisid"] = to_string(station_id);
+	station["lpnn"] = "";
+	station["elevation"] = pos.elevation;
+
+	return station;
+}
+
+void NFmiPGCLDB::RefreshMovingTracks()
+{
+	const time_t now = time(nullptr);
+
+	if (itsMovingTracksRefreshed > 0 && now - itsMovingTracksRefreshed < 60) return;
+
+	string query =
+	    "SELECT m.station_id, s.station_name, to_char(m.created, 'YYYYMMDDHH24MISS'), m.lat, m.lon, m.elev "
+	    "FROM moving_locations_v1 m JOIN stations_v1 s ON s.station_id = m.station_id WHERE ";
+
+	// Until a refresh has returned rows, samples read individually may be old:
+	// the window query is used as long as there is no watermark
+
+	if (movingtracks.Watermark().empty())
+		query += "m.created > now() - interval '" + to_string(itsMovingTrackHours) + " hours'";
+	else
+		query += "m.created >= to_timestamp('" + movingtracks.Watermark() + "', 'YYYYMMDDHH24MISS')::timestamp";
+
+	Query(query);
+
+	AddMovingRows();
+
+	movingtracks.Prune(now - 3600 * static_cast<time_t>(itsMovingTrackHours));
+	unknown_moving_stations.clear();
+	itsMovingTracksRefreshed = now;
+
+	FMIDEBUG(cout << "DEBUG: Moving station tracks refreshed up to " << movingtracks.Watermark() << endl);
+}
+
+void NFmiPGCLDB::AddMovingRows(bool theWatermark)
+{
+	while (true)
+	{
+		vector<string> values = FetchRow();
+
+		if (values.empty()) break;
+
+		if (values[2].empty() || values[3].empty() || values[4].empty()) continue;
+
+		movingtracks.Add(stoul(values[0]), values[1], values[2], stod(values[3]), stod(values[4]), values[5],
+		                 theWatermark);
+	}
 }
@@ -1,6 +1,11 @@
 #include "NFmiPostgreSQL.h"
 
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
+#include <libpq-fe.h>
+#include <poll.h>
 
 using namespace std;
 
@@ -10,11 +15,34 @@ NFmiPostgreSQL& NFmiPostgreSQL::Instance()
 	return instance_;
 }
 
-NFmiPostgreSQL::NFmiPostgreSQL() : port_(5432), id_(0) {}
-NFmiPostgreSQL::NFmiPostgreSQL(int theId) : port_(5432), id_(theId) {}
+NFmiPostgreSQL::NFmiPostgreSQL()
+    : port_(5432), id_(0), statement_timeout_(0), current_timeout_(0), token_(nullptr), token_id_(0), async_conn_(nullptr),
+      async_cancel_(nullptr)
+{
+}
+NFmiPostgreSQL::NFmiPostgreSQL(int theId)
+    : port_(5432),
+      id_(theId),
+      statement_timeout_(0),
+      current_timeout_(0),
+      token_(nullptr),
+      token_id_(0),
+      async_conn_(nullptr),
+      async_cancel_(nullptr)
+{
+}
 NFmiPostgreSQL::NFmiPostgreSQL(const std::string& user, const std::string& password, const std::string& database,
                                const std::string& hostname, int port)
-    : NFmiDatabase(user, password, database), hostname_(hostname), port_(port), id_(0)
+    : NFmiDatabase(user, password, database),
+      hostname_(hostname),
+      port_(port),
+      id_(0),
+      statement_timeout_(0),
+      current_timeout_(0),
+      token_(nullptr),
+      token_id_(0),
+      async_conn_(nullptr),
+      async_cancel_(nullptr)
 {
 }
 
@@ -44,6 +72,7 @@ void NFmiPostgreSQL::Connect()
 	db_ = unique_ptr<pqxx::connection>(new pqxx::connection(connection_string_));
 	wrk_ = unique_ptr<pqxx::nontransaction>(new pqxx::nontransaction(*db_));
 	connected_ = true;
+	current_timeout_ = 0;
 
 	FMIDEBUG(cout << "DEBUG: connected to PostgreSQL " << database_ << endl);
 }
@@ -56,9 +85,21 @@ void NFmiPostgreSQL::Query(const string& sql)
 		exit(1);
 	}
 
-	FMIDEBUG(cout << "DEBUG: " << sql << endl);
+	const string query = PrepareQuery(sql);
+
+	FMIDEBUG(cout << "DEBUG: " << query << endl);
+
+	try
+	{
+		res_ = wrk_->exec(query);
+	}
+	catch (...)
+	{
+		// statement_timeout is rolled back together with the failed query
+		current_timeout_ = -1;
+		throw;
+	}
 
-	res_ = wrk_->exec(sql);
 	iter_ = res_.begin();
 
 	FMIDEBUG(cout << "DEBUG: query returned " << res_.size() << " rows" << endl);
@@ -105,22 +146,124 @@ vector<string> NFmiPostgreSQL::FetchRow()
 
 void NFmiPostgreSQL::Execute(const string& sql)
 {
-	FMIDEBUG(cout << "DEBUG: " << sql << endl);
+	const string query = PrepareQuery(sql);
+
+	FMIDEBUG(cout << "DEBUG: " << query << endl);
 
 	try
 	{
-		wrk_->exec(sql);
+		wrk_->exec(query);
 	}
 	catch (const pqxx::unique_violation& e)
 	{
 		// let caller deal with this
+		current_timeout_ = -1;
 		throw e;
 	}
+	catch (...)
+	{
+		current_timeout_ = -1;
+		throw;
+	}
+}
+
+/*
+ * PrepareQuery()
+ *
+ * Checks the cancellation token and works out the statement timeout for the
+ * next query. If it differs from the one last sent to server, a SET command is
+ * prepended to the query so that both are sent in the same round trip; the
+ * result of a multi-statement query is that of the last statement.
+ */
+
+string NFmiPostgreSQL::PrepareQuery(const string& sql)
+{
+	const int timeout = QueryTimeout();
+
+	if (timeout == current_timeout_)
+	{
+		return sql;
+	}
+
+	current_timeout_ = timeout;
+
+	return "SET statement_timeout = " + to_string(timeout) + "; " + sql;
+}
+
+/*
+ * QueryTimeout()
+ *
+ * Statement timeout for the next query, shortened to the deadline of the
+ * cancellation token. Throws if the token has been cancelled.
+ */
+
+int NFmiPostgreSQL::QueryTimeout() const
+{
+	int timeout = statement_timeout_;
+
+	if (token_)
+	{
+		if (token_->Cancelled())
+		{
+			throw runtime_error("NFmiPostgreSQL: query cancelled");
+		}
+
+		const int remaining = token_->Remaining();
+
+		if (remaining >= 0 && (timeout == 0 || remaining < timeout))
+		{
+			timeout = max(remaining, 1);
+		}
+	}
+
+	return timeout;
+}
+
+void NFmiPostgreSQL::CancellationToken(NFmiCancellationToken* theToken)
+{
+	if (token_)
+	{
+		token_->Unregister(token_id_);
+	}
+
+	token_ = theToken;
+
+	if (token_)
+	{
+		// Called from another thread; libpq cancel requests are thread safe
+
+		token_id_ = token_->Register(
+		    [this]()
+		    {
+			    if (connected_)
+			    {
+				    FMIDEBUG(cout << "DEBUG: cancelling query" << endl);
+				    db_->cancel_query();
+			    }
+
+			    lock_guard<mutex> lock(async_cancel_mutex_);
+
+			    if (async_cancel_)
+			    {
+				    char error[256];
+
+				    FMIDEBUG(cout << "DEBUG: cancelling asynchronous query" << endl);
+				    PQcancel(async_cancel_, error, sizeof(error));
+			    }
+		    });
+	}
 }
 
 NFmiPostgreSQL::~NFmiPostgreSQL() { Disconnect(); }
 void NFmiPostgreSQL::Disconnect()
 {
+	CancellationToken(nullptr);
+
+	if (async_conn_)
+	{
+		FailAsync("NFmiPostgreSQL: disconnected before query completed");
+	}
+
 	if (connected_)
 	{
 #if PQXX_VERSION_MAJOR < 7
@@ -163,6 +306,333 @@ void NFmiPostgreSQL::Rollback()
 	wrk_ = unique_ptr<pqxx::nontransaction>(new pqxx::nontransaction(*db_));
 }
 
+/*
+ * OpenAsync()
+ *
+ * Opens the connection used for asynchronous queries. If libpq supports
+ * it, the connection is put to pipeline mode so that all queued queries
+ * can be sent to the server at once; otherwise they are sent one by one
+ * as the previous one completes.
+ */
+
+void NFmiPostgreSQL::OpenAsync()
+{
+	if (async_conn_)
+		return;
+
+	if (!connected_)
+		throw runtime_error("NFmiPostgreSQL: must be connected before executing query");
+
+	async_conn_ = PQconnectdb(connection_string_.c_str());
+
+	if (PQstatus(async_conn_) != CONNECTION_OK)
+	{
+		const string error = PQerrorMessage(async_conn_);
+		CloseAsync();
+		throw runtime_error("NFmiPostgreSQL: unable to open asynchronous connection: " + error);
+	}
+
+	if (PQsetnonblocking(async_conn_, 1) != 0)
+	{
+		const string error = PQerrorMessage(async_conn_);
+		CloseAsync();
+		throw runtime_error("NFmiPostgreSQL: unable to set connection non-blocking: " + error);
+	}
+
+#ifdef LIBPQ_HAS_PIPELINING
+	if (PQenterPipelineMode(async_conn_) != 1)
+	{
+		const string error = PQerrorMessage(async_conn_);
+		CloseAsync();
+		throw runtime_error("NFmiPostgreSQL: unable to enter pipeline mode: " + error);
+	}
+#endif
+
+	{
+		lock_guard<mutex> lock(async_cancel_mutex_);
+		async_cancel_ = PQgetCancel(async_conn_);
+	}
+
+	FMIDEBUG(cout << "DEBUG: asynchronous connection to PostgreSQL " << database_ << " opened" << endl);
+}
+
+void NFmiPostgreSQL::CloseAsync()
+{
+	{
+		lock_guard<mutex> lock(async_cancel_mutex_);
+
+		if (async_cancel_)
+		{
+			PQfreeCancel(async_cancel_);
+			async_cancel_ = nullptr;
+		}
+	}
+
+	if (async_conn_)
+	{
+		PQfinish(async_conn_);
+		async_conn_ = nullptr;
+	}
+}
+
+void NFmiPostgreSQL::SendAsync(const AsyncQuery& theQuery)
+{
+	FMIDEBUG(cout << "DEBUG: async: " << theQuery.sql << endl);
+
+	// Statement timeout goes with every query: a query failing rolls back the SET
+	// with it, and in pipeline mode the queries after it may already have been sent
+
+	const string timeout = "SET statement_timeout = " + to_string(QueryTimeout());
+
+#ifdef LIBPQ_HAS_PIPELINING
+	// Simple query protocol is not allowed in pipeline mode. Each query gets
+	// a sync point of its own, so that an error does not abort the ones after it.
+
+	if (PQsendQueryParams(async_conn_, timeout.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 0) != 1 ||
+	    PQsendQueryParams(async_conn_, theQuery.sql.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 0) != 1 ||
+	    PQpipelineSync(async_conn_) != 1)
+#else
+	if (PQsendQuery(async_conn_, (timeout + "; " + theQuery.sql).c_str()) != 1)
+#endif
+	{
+		throw runtime_error(string("NFmiPostgreSQL: unable to send query: ") + PQerrorMessage(async_conn_));
+	}
+
+	if (PQflush(async_conn_) == -1)
+	{
+		throw runtime_error(string("NFmiPostgreSQL: unable to send query: ") + PQerrorMessage(async_conn_));
+	}
+}
+
+/*
+ * QueryAsync()
+ *
+ * Queues a query. The callback is called from PollAsync() with either the
+ * rows of the result, with NULL values as empty strings, or an exception.
+ */
+
+void NFmiPostgreSQL::QueryAsync(const string& sql, AsyncCallback theCallback)
+{
+	if (token_ && token_->Cancelled())
+	{
+		throw runtime_error("NFmiPostgreSQL: query cancelled");
+	}
+
+	OpenAsync();
+
+	async_queue_.push_back(AsyncQuery{sql, move(theCallback), AsyncResult(), ""});
+
+#ifndef LIBPQ_HAS_PIPELINING
+	if (async_queue_.size() > 1)
+	{
+		// Sent when the queries before it have completed
+		return;
+	}
+#endif
+
+	try
+	{
+		SendAsync(async_queue_.back());
+	}
+	catch (...)
+	{
+		async_queue_.pop_back();
+		throw;
+	}
+}
+
+future<NFmiPostgreSQL::AsyncResult> NFmiPostgreSQL::QueryAsync(const string& sql)
+{
+	auto promise = make_shared<std::promise<AsyncResult>>();
+
+	QueryAsync(sql,
+	           [promise](AsyncResult&& theResult, exception_ptr theError)
+	           {
+		           if (theError)
+			           promise->set_exception(theError);
+		           else
+			           promise->set_value(move(theResult));
+	           });
+
+	return promise->get_future();
+}
+
+/*
+ * CompleteAsync()
+ *
+ * Removes the first query from queue and delivers its result. In non-pipeline
+ * mode the next query in queue is sent before the callback is called.
+ */
+
+void NFmiPostgreSQL::CompleteAsync()
+{
+	AsyncQuery query = move(async_queue_.front());
+	async_queue_.pop_front();
+
+#ifndef LIBPQ_HAS_PIPELINING
+	if (!async_queue_.empty())
+	{
+		try
+		{
+			SendAsync(async_queue_.front());
+		}
+		catch (const std::exception& e)
+		{
+			FailAsync(e.what());
+		}
+	}
+#endif
+
+	if (!query.error.empty())
+	{
+		query.callback(AsyncResult(), make_exception_ptr(runtime_error("NFmiPostgreSQL: " + query.error)));
+	}
+	else
+	{
+		query.callback(move(query.result), exception_ptr());
+	}
+}
+
+/*
+ * FailAsync()
+ *
+ * Closes the asynchronous connection and fails all queued queries. The
+ * connection is reopened when next query is queued.
+ */
+
+void NFmiPostgreSQL::FailAsync(const string& theError)
+{
+	deque<AsyncQuery> queue;
+	queue.swap(async_queue_);
+
+	CloseAsync();
+
+	for (auto& query : queue)
+	{
+		query.callback(AsyncResult(), make_exception_ptr(runtime_error(theError)));
+	}
+}
+
+size_t NFmiPostgreSQL::PollAsync(int theTimeout)
+{
+	if (async_queue_.empty())
+		return 0;
+
+	pollfd pfd;
+	pfd.fd = PQsocket(async_conn_);
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	const int flushed = PQflush(async_conn_);
+
+	if (flushed == -1)
+	{
+		const size_t failed = async_queue_.size();
+		FailAsync(string("NFmiPostgreSQL: unable to send query: ") + PQerrorMessage(async_conn_));
+		return failed;
+	}
+	else if (flushed == 1)
+	{
+		pfd.events |= POLLOUT;
+	}
+
+	const int ready = poll(&pfd, 1, theTimeout);
+
+	if (ready < 0)
+	{
+		if (errno == EINTR)
+			return 0;
+
+		throw runtime_error(string("NFmiPostgreSQL: poll failed: ") + strerror(errno));
+	}
+	else if (ready == 0 || (pfd.revents & ~POLLOUT) == 0)
+	{
+		return 0;
+	}
+
+	if (PQconsumeInput(async_conn_) != 1)
+	{
+		const size_t failed = async_queue_.size();
+		FailAsync(string("NFmiPostgreSQL: connection lost: ") + PQerrorMessage(async_conn_));
+		return failed;
+	}
+
+	size_t completed = 0;
+
+	while (!async_queue_.empty() && PQisBusy(async_conn_) == 0)
+	{
+		PGresult* res = PQgetResult(async_conn_);
+		AsyncQuery& query = async_queue_.front();
+
+		if (res == nullptr)
+		{
+#ifndef LIBPQ_HAS_PIPELINING
+			// No more results for this query
+			CompleteAsync();
+			completed++;
+#endif
+			continue;
+		}
+
+		switch (PQresultStatus(res))
+		{
+			case PGRES_TUPLES_OK:
+			{
+				const int rows = PQntuples(res);
+				const int cols = PQnfields(res);
+
+				query.result.reserve(query.result.size() + rows);
+
+				for (int i = 0; i < rows; i++)
+				{
+					vector<string> row(cols);
+
+					for (int j = 0; j < cols; j++)
+					{
+						if (!PQgetisnull(res, i, j))
+						{
+							row[j] = string(PQgetvalue(res, i, j), PQgetlength(res, i, j));
+						}
+					}
+
+					query.result.push_back(move(row));
+				}
+				break;
+			}
+			case PGRES_COMMAND_OK:
+				break;
+#ifdef LIBPQ_HAS_PIPELINING
+			case PGRES_PIPELINE_SYNC:
+				PQclear(res);
+				CompleteAsync();
+				completed++;
+				continue;
+#endif
+			default:
+				if (query.error.empty())
+				{
+					query.error = PQresultErrorMessage(res);
+				}
+				break;
+		}
+
+		PQclear(res);
+	}
+
+	FMIDEBUG(if (completed) cout << "DEBUG: " << completed << " asynchronous queries completed, "
+	                             << async_queue_.size() << " pending" << endl);
+
+	return completed;
+}
+
+void NFmiPostgreSQL::WaitAsync()
+{
+	while (!async_queue_.empty())
+	{
+		PollAsync(-1);
+	}
+}
+
 /*
  * MakeStandardDate()
  *
@@ -1,10 +1,15 @@
 #include "NFmiRadonDB.h"
+#include "NFmiSingleFlight.h"
+#include "NFmiStaleCache.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string_regex.hpp>
+#include <cmath>
 #include <iomanip>
 #include <numeric>
+#include <set>
 
 using namespace std;
 
@@ -12,15 +17,115 @@ const float kFloatMissing = 32700.f;
 
 once_flag paramGrib1Cache, paramGrib2Cache;
 
+// Concurrent cache misses for the same key share one query, also across pool workers.
+// Keys begin with NFmiPostgreSQL::ConnectionKey(), so that only connections to the
+// same database share queries
+NFmiSingleFlight<string, map<string, string>> inflightDefinitions;
+NFmiSingleFlight<string, vector<vector<string>>> inflightGridGeoms;
+
+// Stale-while-revalidate, enabled with NFmiRadonDB::RefreshInterval()
+atomic<int> refreshInterval(0);
+NFmiStaleCache<string, string> staleLatestTimes;
+NFmiStaleCache<string, vector<vector<string>>> staleGridGeoms;
+
+namespace
+{
+struct ConnectionParameters
+{
+	string user;
+	string password;
+	string database;
+	string hostname;
+	int port;
+};
+
+/*
+ * Runs theFunction for a background refresh. Refreshes only run on the worker
+ * thread of a stale cache, which keeps one connection per database open for
+ * its lifetime; a connection is dropped and made again after a failure.
+ */
+
+template <typename T>
+T Refreshed(const ConnectionParameters& theParameters, const function<T(NFmiRadonDB&)>& theFunction)
+{
+	thread_local map<string, unique_ptr<NFmiRadonDB>> connections;
+
+	const string key = theParameters.user + "@" + theParameters.hostname + ":" + to_string(theParameters.port) + "/" +
+	                   theParameters.database;
+
+	auto& db = connections[key];
+
+	try
+	{
+		if (!db)
+		{
+			db.reset(new NFmiRadonDB());
+			db->Connect(theParameters.user, theParameters.password, theParameters.database, theParameters.hostname,
+			            theParameters.port);
+		}
+
+		return theFunction(*db);
+	}
+	catch (...)
+	{
+		connections.erase(key);
+		throw;
+	}
+}
+}  // namespace
+
 #pragma GCC diagnostic ignored "-Wwrite-strings"
 
+/*
+ * OwnFailure()
+ *
+ * Classifier for single-flight calls: a failure caused by the cancellation
+ * token or the statement timeout of this connection is not shared with the
+ * callers waiting for the same result, one of them runs the query instead.
+ */
+
+function<bool(const exception_ptr&)> NFmiRadonDB::OwnFailure() const
+{
+	return [this](const exception_ptr& theError)
+	{
+		if (token_ && token_->Cancelled())
+		{
+			return true;
+		}
+
+		try
+		{
+			rethrow_exception(theError);
+		}
+		catch (const pqxx::query_cancelled&)
+		{
+			return true;
+		}
+		catch (...)
+		{
+		}
+
+		return false;
+	};
+}
+
 NFmiRadonDB& NFmiRadonDB::Instance()
 {
 	static NFmiRadonDB instance_;
 	return instance_;
 }
 
-NFmiRadonDB::NFmiRadonDB(short theId) : NFmiPostgreSQL(), itsId(theId), itsRadonVersion(-1)
+NFmiRadonDB::NFmiRadonDB(short theId)
+    : NFmiPostgreSQL(),
+      itsGeometryCatalog(false),
+      itsGeometryPreload(false),
+      itsGeometriesPreloaded(false),
+      itsStationCatalogLoaded(false),
+      itsLatestTimeTTL(0),
+      itsAvailabilityRefresh(60),
+      itsLevelPrefetch(false),
+      itsId(theId),
+      itsRadonVersion(-1)
 {
 }
 NFmiRadonDB::~NFmiRadonDB()
@@ -596,14 +701,7 @@ void NFmiRadonDB::WarmGrib2ParameterCache(long producerId)
 map<string, string> NFmiRadonDB::GetParameterFromGrib1(long producerId, long tableVersion, long paramId,
                                                        long timeRangeIndicator, long levelId, double levelValue)
 {
-	string key = to_string(producerId) + "_" + to_string(tableVersion) + "_" + to_string(paramId) + "_" +
-	             to_string(timeRangeIndicator) + "_" + to_string(levelId);
-
-	if (levelId != 109)
-	{
-		// Do not cache hybrid level value
-		key += "_" + to_string(levelValue);
-	}
+	const string key = Grib1ParameterKey(producerId, tableVersion, paramId, timeRangeIndicator, levelId, levelValue);
 
 	if (paramgrib1info.find(key) != paramgrib1info.end())
 	{
@@ -612,37 +710,59 @@ map<string, string> NFmiRadonDB::GetParameterFromGrib1(long producerId, long tab
 		return paramgrib1info[key];
 	}
 
-	stringstream query;
-
-	query << "SELECT p.id, p.name, 1 AS version, p.interpolation_id "
-	      << "FROM param_grib1 g, level_grib1 l, param p "
-	      << "WHERE g.param_id = p.id"
-	      << " AND g.producer_id = " << producerId << " AND table_version = " << tableVersion
-	      << " AND number = " << paramId << " AND timerange_indicator = " << timeRangeIndicator
-	      << " AND (g.level_id IS NULL OR (g.level_id = l.level_id AND l.grib_level_id = " << levelId << "))"
-	      << " AND (level_value IS NULL OR level_value = " << levelValue << ")"
-	      << " ORDER BY g.level_id NULLS LAST, level_value NULLS LAST LIMIT 1";
+	if (itsLevelPrefetch && levelId != 109)
+	{
+		const string levelKey = "grib1_" + to_string(producerId) + "_" + to_string(tableVersion) + "_" +
+		                        to_string(paramId) + "_" + to_string(timeRangeIndicator) + "_" + to_string(levelId);
 
-	Query(query.str());
+		stringstream query;
 
-	vector<string> row = FetchRow();
+		query << "SELECT p.id, p.name, 1 AS version, p.interpolation_id, g.level_value "
+		      << "FROM param_grib1 g, level_grib1 l, param p "
+		      << "WHERE g.param_id = p.id"
+		      << " AND g.producer_id = " << producerId << " AND table_version = " << tableVersion
+		      << " AND number = " << paramId << " AND timerange_indicator = " << timeRangeIndicator
+		      << " AND (g.level_id IS NULL OR (g.level_id = l.level_id AND l.grib_level_id = " << levelId << "))"
+		      << " ORDER BY g.level_id NULLS LAST, level_value NULLS LAST";
 
-	map<string, string> ret;
+		vector<string> row;
 
-	if (row.empty())
-	{
-		FMIDEBUG(cout << "DEBUG Parameter not found\n");
-	}
-	else
-	{
-		ret["id"] = row[0];
-		ret["name"] = row[1];
-		ret["version"] = row[2];
-		ret["grib1_table_version"] = to_string(tableVersion);
-		ret["grib1_number"] = to_string(paramId);
-		ret["interpolation_method"] = row[3];
+		if (PrefetchedLevel(levelKey, query.str(), 4, levelValue, row))
+		{
+			paramgrib1info[key] = Grib1ParameterRow(row, tableVersion, paramId);
+			return paramgrib1info[key];
+		}
 	}
 
+	const auto ret = inflightDefinitions.Do(
+	    ConnectionKey() + "_grib1_" + key,
+	    [&]()
+	    {
+		    stringstream query;
+
+		    query << "SELECT p.id, p.name, 1 AS version, p.interpolation_id "
+		          << "FROM param_grib1 g, level_grib1 l, param p "
+		          << "WHERE g.param_id = p.id"
+		          << " AND g.producer_id = " << producerId << " AND table_version = " << tableVersion
+		          << " AND number = " << paramId << " AND timerange_indicator = " << timeRangeIndicator
+		          << " AND (g.level_id IS NULL OR (g.level_id = l.level_id AND l.grib_level_id = " << levelId << "))"
+		          << " AND (level_value IS NULL OR level_value = " << levelValue << ")"
+		          << " ORDER BY g.level_id NULLS LAST, level_value NULLS LAST LIMIT 1";
+
+		    Query(query.str());
+
+		    vector<string> row = FetchRow();
+
+		    if (row.empty())
+		    {
+			    FMIDEBUG(cout << "DEBUG Parameter not found\n");
+			    return map<string, string>();
+		    }
+
+		    return Grib1ParameterRow(row, tableVersion, paramId);
+	    },
+	    OwnFailure());
+
 	paramgrib1info[key] = ret;
 
 	return ret;
@@ -651,6 +771,87 @@ map<string, string> NFmiRadonDB::GetParameterFromGrib1(long producerId, long tab
 map<string, string> NFmiRadonDB::GetParameterFromGrib2(long producerId, long discipline, long category, long paramId,
                                                        long levelId, double levelValue,
                                                        long typeOfStatisticalProcessing)
+{
+	const string key =
+	    ParameterGrib2Key(producerId, discipline, category, paramId, levelId, levelValue, typeOfStatisticalProcessing);
+
+	if (paramgrib2info.find(key) != paramgrib2info.end())
+	{
+		FMIDEBUG(cout << "DEBUG: ParameterFromGrib2() cache hit for " << key << endl);
+
+		return paramgrib2info[key];
+	}
+
+	if (itsLevelPrefetch && levelId != 105)
+	{
+		const string levelKey = "grib2_" + to_string(producerId) + "_" + to_string(discipline) + "_" +
+		                        to_string(category) + "_" + to_string(paramId) + "_" +
+		                        to_string(typeOfStatisticalProcessing) + "_" + to_string(levelId);
+
+		stringstream query;
+
+		query << "SELECT p.id, p.name, 1 AS version, u.name AS unit_name, "
+		         "p.interpolation_id, i.name AS interpolation_name, "
+		         "g.level_id, g.level_value "
+		      << "FROM param_grib2 g, level_grib2 l, param p, param_unit u, interpolation_method i, "
+		         "fmi_producer f "
+		      << "WHERE g.param_id = p.id AND p.unit_id = u.id AND "
+		         "p.interpolation_id = i.id AND f.id = g.producer_id "
+		      << " AND f.id = " << producerId << " AND discipline = " << discipline << " AND category = " << category
+		      << " AND number = " << paramId
+		      << " AND (g.level_id IS NULL OR (g.level_id = l.level_id AND l.grib_level_id = " << levelId << "))"
+		      << " AND g.type_of_statistical_processing = " << typeOfStatisticalProcessing
+		      << " ORDER BY g.level_id NULLS LAST, level_value NULLS LAST";
+
+		vector<string> row;
+
+		if (PrefetchedLevel(levelKey, query.str(), 7, levelValue, row))
+		{
+			paramgrib2info[key] = ParameterGrib2Row(row, discipline, category, paramId, typeOfStatisticalProcessing);
+			return paramgrib2info[key];
+		}
+	}
+
+	const auto ret = inflightDefinitions.Do(
+	    ConnectionKey() + "_grib2_" + key,
+	    [&]()
+	    {
+		    Query(ParameterGrib2Query(producerId, discipline, category, paramId, levelId, levelValue,
+		                              typeOfStatisticalProcessing));
+
+		    vector<string> row = FetchRow();
+
+		    if (row.empty())
+		    {
+			    Query(ParameterGrib2TemplateQuery(discipline, category, paramId, typeOfStatisticalProcessing));
+			    row = FetchRow();
+
+			    if (row.empty())
+			    {
+				    FMIDEBUG(cout << "DEBUG Parameter not found\n");
+				    return map<string, string>();
+			    }
+		    }
+
+		    return ParameterGrib2Row(row, discipline, category, paramId, typeOfStatisticalProcessing);
+	    },
+	    OwnFailure());
+
+	paramgrib2info[key] = ret;
+
+	return ret;
+}
+
+/*
+ * ParameterGrib2Key()
+ *
+ * Cache key, query builders and row parser for GetParameterFromGrib2().
+ * Kept separate from the lookup so that they can be shared by the
+ * asynchronous version.
+ */
+
+string NFmiRadonDB::ParameterGrib2Key(long producerId, long discipline, long category, long paramId, long levelId,
+                                      double levelValue, long typeOfStatisticalProcessing)
 {
 	string key = to_string(producerId) + "_" + to_string(discipline) + "_" + to_string(category) + "_" +
 	             to_string(paramId) + "_" + to_string(typeOfStatisticalProcessing) + "_" + to_string(levelId);
@@ -661,13 +862,12 @@ map<string, string> NFmiRadonDB::GetParameterFromGrib2(long producerId, long dis
 		key += "_" + to_string(levelValue);
 	}
 
-	if (paramgrib2info.find(key) != paramgrib2info.end())
-	{
-		FMIDEBUG(cout << "DEBUG: ParameterFromGrib2() cache hit for " << key << endl);
-
-		return paramgrib2info[key];
-	}
+	return key;
+}
 
+string NFmiRadonDB::ParameterGrib2Query(long producerId, long discipline, long category, long paramId, long levelId,
+                                        double levelValue, long typeOfStatisticalProcessing)
+{
 	stringstream query;
 
 	query << "SELECT p.id, p.name, 1 AS version, u.name AS unit_name, "
@@ -684,30 +884,26 @@ map<string, string> NFmiRadonDB::GetParameterFromGrib2(long producerId, long dis
 	      << " AND g.type_of_statistical_processing = " << typeOfStatisticalProcessing
 	      << " ORDER BY g.level_id NULLS LAST, level_value NULLS LAST LIMIT 1";
 
-	Query(query.str());
-
-	vector<string> row = FetchRow();
+	return query.str();
+}
 
-	map<string, string> ret;
+string NFmiRadonDB::ParameterGrib2TemplateQuery(long discipline, long category, long paramId,
+                                                long typeOfStatisticalProcessing)
+{
+	stringstream query;
 
-	if (row.empty())
-	{
-		query.str("");
-		query << "SELECT p.id, p.name, 1 AS version, p.interpolation_id, "
-		      << "NULL, NULL FROM param p, param_grib2_template t WHERE "
-		      << "p.id = t.param_id AND t.discipline = " << discipline << " AND t.category = " << category << " AND "
-		      << "t.number = " << paramId << " AND t.type_of_statistical_processing = " << typeOfStatisticalProcessing;
+	query << "SELECT p.id, p.name, 1 AS version, p.interpolation_id, "
+	      << "NULL, NULL FROM param p, param_grib2_template t WHERE "
+	      << "p.id = t.param_id AND t.discipline = " << discipline << " AND t.category = " << category << " AND "
+	      << "t.number = " << paramId << " AND t.type_of_statistical_processing = " << typeOfStatisticalProcessing;
 
-		Query(query.str());
-		row = FetchRow();
+	return query.str();
+}
 
-		if (row.empty())
-		{
-			FMIDEBUG(cout << "DEBUG Parameter not found\n");
-			paramgrib2info[key] = ret;
-			return ret;
-		}
-	}
+map<string, string> NFmiRadonDB::ParameterGrib2Row(const vector<string>& row, long discipline, long category,
+                                                   long paramId, long typeOfStatisticalProcessing)
+{
+	map<string, string> ret;
 
 	ret["id"] = row[0];
 	ret["name"] = row[1];
@@ -717,11 +913,9 @@ map<string, string> NFmiRadonDB::GetParameterFromGrib2(long producerId, long dis
 	ret["grib2_number"] = to_string(paramId);
 	ret["interpolation_method"] = row[4];
 	ret["level_id"] = row[5];
-	ret["level_value"] = row[6];
+	ret["level_value"] = row.size() > 6 ? row[6] : "";
 	ret["type_of_statistical_processing"] = to_string(typeOfStatisticalProcessing);
 
-	paramgrib2info[key] = ret;
-
 	return ret;
 }
 
@@ -758,11 +952,7 @@ map<string, string> NFmiRadonDB::GetParameterFromGeoTIFF(long producerId, const
 	}
 	else
 	{
-		ret["id"] = row[0];
-		ret["name"] = row[1];
-		ret["version"] = row[2];
-		ret["geotiff_name"] = paramName;
-		ret["interpolation_method"] = row[4];
+		ret = GeoTIFFParameterRow(row, paramName);
 
 		paramgeotiffinfo[key] = ret;
 	}
@@ -773,7 +963,7 @@ map<string, string> NFmiRadonDB::GetParameterFromGeoTIFF(long producerId, const
 map<string, string> NFmiRadonDB::GetParameterFromNetCDF(long producerId, const string& paramName, long levelId,
                                                         double levelValue)
 {
-	const string key = to_string(producerId) + "_" + paramName + "_" + to_string(levelId) + "_" + to_string(levelValue);
+	const string key = NetCDFParameterKey(producerId, paramName, levelId, levelValue);
 
 	if (paramnetcdfinfo.find(key) != paramnetcdfinfo.end())
 	{
@@ -808,13 +998,7 @@ map<string, string> NFmiRadonDB::GetParameterFromNetCDF(long producerId, const s
 	}
 	else
 	{
-		ret["id"] = row[0];
-		ret["name"] = row[1];
-		ret["version"] = row[2];
-		ret["netcdf_name"] = paramName;
-		ret["interpolation_method"] = row[4];
-		ret["level_id"] = row[5];
-		ret["level_value"] = row[6];
+		ret = NetCDFParameterRow(row, paramName);
 
 		paramnetcdfinfo[key] = ret;
 	}
@@ -822,322 +1006,1130 @@ map<string, string> NFmiRadonDB::GetParameterFromNetCDF(long producerId, const s
 	return ret;
 }
 
-map<string, string> NFmiRadonDB::GetParameterPrecision(const std::string& paramName)
+string NFmiRadonDB::Grib1ParameterKey(long producerId, long tableVersion, long paramId, long timeRangeIndicator,
+                                      long levelId, double levelValue)
 {
-	map<string, string> ret;
-
-	stringstream query;
-	query << "SELECT pp.id, pp.precision FROM param_precision pp, param p  WHERE p.name = '" << paramName
-	      << "' AND p.id = pp.param_id";
-
-	Query(query.str());
-
-	vector<string> row = FetchRow();
+	string key = to_string(producerId) + "_" + to_string(tableVersion) + "_" + to_string(paramId) + "_" +
+	             to_string(timeRangeIndicator) + "_" + to_string(levelId);
 
-	if (row.empty())
-	{
-		FMIDEBUG(cout << "DEBUG Parameter " << paramName << " not found\n");
-	}
-	else
+	if (levelId != 109)
 	{
-		ret["id"] = row[0];
-		ret["precision"] = row[1];
+		// Do not cache hybrid level value
+		key += "_" + to_string(levelValue);
 	}
 
-	return ret;
+	return key;
 }
 
-string NFmiRadonDB::GetNewbaseNameFromUnivId(unsigned long univ_id)
+map<string, string> NFmiRadonDB::Grib1ParameterRow(const vector<string>& row, long tableVersion, long paramId)
 {
-	string ret;
-	stringstream q;
+	map<string, string> ret;
 
-	q << "SELECT p.name FROM param_newbase_name p WHERE p.univ_id = " << univ_id;
-	Query(q.str());
+	ret["id"] = row[0];
+	ret["name"] = row[1];
+	ret["version"] = row[2];
+	ret["grib1_table_version"] = to_string(tableVersion);
+	ret["grib1_number"] = to_string(paramId);
+	ret["interpolation_method"] = row[3];
 
-	vector<string> row = FetchRow();
-	if (row.empty())
-	{
-		FMIDEBUG(cout << "DEBUG Parameter not found: " << univ_id << "\n");
-	}
-	else
-	{
-		ret = row[0];
-	}
 	return ret;
 }
 
-map<string, string> NFmiRadonDB::GetLevelFromDatabaseName(const std::string& name)
+string NFmiRadonDB::NetCDFParameterKey(long producerId, const string& paramName, long levelId, double levelValue)
 {
-	if (levelnameinfo.find(name) != levelnameinfo.end())
-	{
-		FMIDEBUG(cout << "DEBUG: GetLevelFromDatabaseName() cache hit for " << name << endl);
-
-		return levelnameinfo[name];
-	}
-
-	stringstream query;
+	return to_string(producerId) + "_" + paramName + "_" + to_string(levelId) + "_" + to_string(levelValue);
+}
 
-	query << "SELECT id, name "
-	      << "FROM level "
-	      << " WHERE upper('" << name << "') = name ";
+map<string, string> NFmiRadonDB::NetCDFParameterRow(const vector<string>& row, const string& paramName)
+{
+	map<string, string> ret;
 
-	Query(query.str());
+	ret["id"] = row[0];
+	ret["name"] = row[1];
+	ret["version"] = row[2];
+	ret["netcdf_name"] = paramName;
+	ret["interpolation_method"] = row[4];
+	ret["level_id"] = row[5];
+	ret["level_value"] = row[6];
 
-	vector<string> row = FetchRow();
+	return ret;
+}
 
+map<string, string> NFmiRadonDB::GeoTIFFParameterRow(const vector<string>& row, const string& paramName)
+{
 	map<string, string> ret;
 
-	if (row.empty())
-	{
-		FMIDEBUG(cout << "DEBUG Level not found\n");
-	}
-	else
-	{
-		ret["id"] = row[0];
-		ret["name"] = row[1];
-
-		levelnameinfo[name] = ret;
-	}
+	ret["id"] = row[0];
+	ret["name"] = row[1];
+	ret["version"] = row[2];
+	ret["geotiff_name"] = paramName;
+	ret["interpolation_method"] = row[4];
 
 	return ret;
 }
 
-int NFmiRadonDB::GetGribLevelForProducer(long producerId, long levelId, long edition)
+/*
+ * PrefetchedLevel()
+ *
+ * Resolves a parameter lookup from prefetched level rows. theQuery must
+ * return the same rows as the single lookup query without the level value
+ * condition and LIMIT, with level value in column theLevelColumn. Rows are
+ * fetched when the same level key misses twice in a row. Returns false if
+ * the lookup should be done with the normal query (including when no row
+ * matches, so that fallbacks of the caller still apply).
+ */
+
+bool NFmiRadonDB::PrefetchedLevel(const string& theLevelKey, const string& theQuery, size_t theLevelColumn,
+                                  double theLevelValue, vector<string>& theRow)
 {
-	const string key = to_string(producerId) + "_" + to_string(levelId) + "_" + to_string(edition);
+	auto it = paramlevels.find(theLevelKey);
 
-	if (levelinfo.find(key) != levelinfo.end())
+	if (it == paramlevels.end())
 	{
-		FMIDEBUG(cout << "DEBUG: GetGribLevelForProducer() cache hit for " << key << endl);
-
-		return griblevelinfo[key];
-	}
+		if (itsLastLevelMiss != theLevelKey)
+		{
+			itsLastLevelMiss = theLevelKey;
+			return false;
+		}
 
-	stringstream query;
+		Query(theQuery);
 
-	query << "SELECT grib_level_id FROM " << (edition == 2 ? "level_grib2 g " : "level_grib1 g")
-	      << " WHERE g.producer_id = " << producerId << " AND g.level_id = " << levelId;
+		vector<vector<string>> rows;
 
-	Query(query.str());
+		while (true)
+		{
+			auto row = FetchRow();
 
-	vector<string> row = FetchRow();
+			if (row.empty())
+			{
+				break;
+			}
 
-	int ret;
+			rows.push_back(move(row));
+		}
 
-	if (row.empty())
+		FMIDEBUG(cout << "DEBUG: Prefetched " << rows.size() << " level rows for " << theLevelKey << endl);
+
+		it = paramlevels.emplace(theLevelKey, move(rows)).first;
+	}
+
+	// Level value is compared the way it is written to the single lookup query
+
+	stringstream ss;
+	ss << theLevelValue;
+	const double levelValue = stod(ss.str());
+
+	for (const auto& row : it->second)
 	{
-		FMIDEBUG(cout << "DEBUG Level not found\n");
-		ret = -1;
+		// Not row.back(): FetchRow() appends an extra column for each NULL
+
+		const string& value = row[theLevelColumn];
+
+		if (value.empty() || stod(value) == levelValue)
+		{
+			theRow = row;
+			return true;
+		}
 	}
-	else
+
+	return false;
+}
+
+/*
+ * BatchQuery()
+ *
+ * Runs a batch lookup query whose first column is the index of the lookup
+ * key, and returns the rest of the columns by that index. If the query
+ * returns more than one row for an index, the first one is kept.
+ */
+
+map<size_t, vector<string>> NFmiRadonDB::BatchQuery(const string& query)
+{
+	Query(query);
+
+	map<size_t, vector<string>> ret;
+
+	while (true)
 	{
-		ret = std::stoi(row[0]);
-		griblevelinfo[key] = ret;
+		vector<string> row = FetchRow();
+
+		if (row.empty())
+		{
+			break;
+		}
+
+		const size_t idx = stoul(row[0]);
+		row.erase(row.begin());
+
+		ret.emplace(idx, move(row));
 	}
 
 	return ret;
 }
 
-map<string, string> NFmiRadonDB::GetLevelFromGrib(long producerId, long levelNumber, long edition)
+namespace
 {
-	const string key = to_string(producerId) + "_" + to_string(levelNumber) + "_" + to_string(edition);
+string Quote(const string& str)
+{
+	return "'" + boost::replace_all_copy(str, "'", "''") + "'";
+}
+}  // namespace
 
-	if (levelinfo.find(key) != levelinfo.end())
+/*
+ * GetParametersFromGrib1()
+ *
+ * Batch version of GetParameterFromGrib1(). The per-key query is run for all
+ * keys at once as a lateral subquery over a VALUES list, so the ordering and
+ * NULL level fallback are exactly those of the single key version.
+ */
+
+vector<map<string, string>> NFmiRadonDB::GetParametersFromGrib1(const vector<NFmiGrib1ParameterKey>& keys)
+{
+	vector<map<string, string>> ret(keys.size());
+	map<string, vector<size_t>> misses;  // cache key -> indexes of keys
+
+	for (size_t i = 0; i < keys.size(); i++)
 	{
-		FMIDEBUG(cout << "DEBUG: GetLevelFromGrib() cache hit for " << key << endl);
+		const auto& k = keys[i];
+		const string key =
+		    Grib1ParameterKey(k.producerId, k.tableVersion, k.paramId, k.timeRangeIndicator, k.levelId, k.levelValue);
 
-		return levelinfo[key];
+		const auto it = paramgrib1info.find(key);
+
+		if (it != paramgrib1info.end())
+		{
+			ret[i] = it->second;
+		}
+		else
+		{
+			misses[key].push_back(i);
+		}
+	}
+
+	if (misses.empty())
+	{
+		FMIDEBUG(cout << "DEBUG: GetParametersFromGrib1() all " << keys.size() << " keys from cache" << endl);
+		return ret;
 	}
 
 	stringstream query;
 
-	query << "SELECT id, name "
-	      << "FROM level l, " << (edition == 2 ? "level_grib2 g " : "level_grib1 g") << " WHERE l.id = g.level_id "
-	      << " AND g.producer_id = " << producerId << " AND g.grib_level_id = " << levelNumber;
+	query << "SELECT k.idx, x.* FROM (VALUES ";
 
-	Query(query.str());
+	for (auto it = misses.begin(); it != misses.end(); ++it)
+	{
+		const size_t i = it->second[0];
+		const auto& k = keys[i];
 
-	vector<string> row = FetchRow();
+		query << (it == misses.begin() ? "" : ",") << "(" << i << "," << k.producerId << "," << k.tableVersion << ","
+		      << k.paramId << "," << k.timeRangeIndicator << "," << k.levelId << "," << k.levelValue << ")";
+	}
 
-	map<string, string> ret;
+	query << ") AS k(idx, producer_id, table_version, number, timerange_indicator, grib_level_id, level_value)"
+	      << " CROSS JOIN LATERAL ("
+	      << "SELECT p.id, p.name, 1 AS version, p.interpolation_id "
+	      << "FROM param_grib1 g, level_grib1 l, param p "
+	      << "WHERE g.param_id = p.id"
+	      << " AND g.producer_id = k.producer_id AND g.table_version = k.table_version"
+	      << " AND g.number = k.number AND g.timerange_indicator = k.timerange_indicator"
+	      << " AND (g.level_id IS NULL OR (g.level_id = l.level_id AND l.grib_level_id = k.grib_level_id))"
+	      << " AND (g.level_value IS NULL OR g.level_value = k.level_value)"
+	      << " ORDER BY g.level_id NULLS LAST, g.level_value NULLS LAST LIMIT 1) x";
 
-	if (row.empty())
-	{
-		FMIDEBUG(cout << "DEBUG Level not found\n");
-	}
-	else
+	const auto rows = BatchQuery(query.str());
+
+	for (const auto& miss : misses)
 	{
-		ret["id"] = row[0];
-		ret["name"] = row[1];
-		ret["grib1Number"] = to_string(levelNumber);
+		const auto& k = keys[miss.second[0]];
+		const auto row = rows.find(miss.second[0]);
 
-		levelinfo[key] = ret;
+		map<string, string> def;
+
+		if (row != rows.end())
+		{
+			def = Grib1ParameterRow(row->second, k.tableVersion, k.paramId);
+		}
+
+		paramgrib1info[miss.first] = def;
+
+		for (const auto i : miss.second)
+		{
+			ret[i] = def;
+		}
 	}
 
+	FMIDEBUG(cout << "DEBUG: GetParametersFromGrib1() resolved " << misses.size() << " keys, " << rows.size()
+	              << " found" << endl);
+
 	return ret;
 }
 
-vector<vector<string>> NFmiRadonDB::GetGridGeoms(long producer_id, const string& analtime, const string& geom_name)
+/*
+ * GetParametersFromGrib2()
+ *
+ * Batch version of GetParameterFromGrib2(). Keys that are not found from
+ * param_grib2 are looked up from param_grib2_template with a second query.
+ */
+
+vector<map<string, string>> NFmiRadonDB::GetParametersFromGrib2(const vector<NFmiGrib2ParameterKey>& keys)
 {
-	const string key = to_string(producer_id) + "_" + analtime + "_" + geom_name;
-	if (gridgeoms.count(key) > 0)
+	vector<map<string, string>> ret(keys.size());
+	map<string, vector<size_t>> misses;
+
+	for (size_t i = 0; i < keys.size(); i++)
 	{
-		FMIDEBUG(cout << "DEBUG: GetGridGeoms() cache hit!" << endl);
+		const auto& k = keys[i];
+		const string key = ParameterGrib2Key(k.producerId, k.discipline, k.category, k.paramId, k.levelId,
+		                                     k.levelValue, k.typeOfStatisticalProcessing);
 
-		return gridgeoms[key];
+		const auto it = paramgrib2info.find(key);
+
+		if (it != paramgrib2info.end())
+		{
+			ret[i] = it->second;
+		}
+		else
+		{
+			misses[key].push_back(i);
+		}
+	}
+
+	if (misses.empty())
+	{
+		FMIDEBUG(cout << "DEBUG: GetParametersFromGrib2() all " << keys.size() << " keys from cache" << endl);
+		return ret;
 	}
 
 	stringstream query;
 
-	query << "SELECT g.geometry_id, a.table_name, a.id, "
-	         "g.geom_name, a.schema_name, a.partition_name"
-	      << " FROM as_grid_v a, fmi_producer f, geom_v g"
-	      << " WHERE a.record_count > 0"
-	      << " AND f.id = " << producer_id << " AND a.producer_id = f.id"
-	      << " AND (min_analysis_time, max_analysis_time) OVERLAPS ('" << analtime << "', '" << analtime << "')"
-	      << " AND a.geometry_name = g.geom_name";
+	query << "SELECT k.idx, x.* FROM (VALUES ";
 
-	if (!geom_name.empty())
+	for (auto it = misses.begin(); it != misses.end(); ++it)
 	{
-		query << " AND g.geom_name = '" << geom_name << "'";
+		const size_t i = it->second[0];
+		const auto& k = keys[i];
+
+		query << (it == misses.begin() ? "" : ",") << "(" << i << "," << k.producerId << "," << k.discipline << ","
+		      << k.category << "," << k.paramId << "," << k.levelId << "," << k.levelValue << ","
+		      << k.typeOfStatisticalProcessing << ")";
 	}
 
-	Query(query.str());
+	query << ") AS k(idx, producer_id, discipline, category, number, grib_level_id, level_value, "
+	         "type_of_statistical_processing)"
+	      << " CROSS JOIN LATERAL ("
+	      << "SELECT p.id, p.name, 1 AS version, u.name AS unit_name, "
+	         "p.interpolation_id, i.name AS interpolation_name, "
+	         "g.level_id "
+	      << "FROM param_grib2 g, level_grib2 l, param p, param_unit u, interpolation_method i "
+	      << "WHERE g.param_id = p.id AND p.unit_id = u.id AND p.interpolation_id = i.id"
+	      << " AND g.producer_id = k.producer_id AND g.discipline = k.discipline AND g.category = k.category"
+	      << " AND g.number = k.number"
+	      << " AND (g.level_id IS NULL OR (g.level_id = l.level_id AND l.grib_level_id = k.grib_level_id))"
+	      << " AND (g.level_value IS NULL OR g.level_value = k.level_value)"
+	      << " AND g.type_of_statistical_processing = k.type_of_statistical_processing"
+	      << " ORDER BY g.level_id NULLS LAST, g.level_value NULLS LAST LIMIT 1) x";
 
-	vector<vector<string>> ret;
+	auto rows = BatchQuery(query.str());
 
-	while (true)
+	// Template fallback for the ones not found
+
+	query.str("");
+
+	for (const auto& miss : misses)
 	{
-		vector<string> values = FetchRow();
+		const size_t i = miss.second[0];
 
-		if (values.empty())
+		if (rows.count(i))
 		{
-			break;
+			continue;
 		}
 
-		ret.push_back(values);
+		const auto& k = keys[i];
+
+		query << (query.tellp() == 0 ? "" : ",") << "(" << i << "," << k.discipline << "," << k.category << ","
+		      << k.paramId << "," << k.typeOfStatisticalProcessing << ")";
 	}
 
-	gridgeoms[key] = ret;
+	if (query.tellp() > 0)
+	{
+		const string values = query.str();
+
+		query.str("");
+		query << "SELECT DISTINCT ON (k.idx) k.idx, p.id, p.name, 1 AS version, p.interpolation_id, NULL, NULL "
+		      << "FROM (VALUES " << values
+		      << ") AS k(idx, discipline, category, number, type_of_statistical_processing)"
+		      << " JOIN param_grib2_template t ON (t.discipline = k.discipline AND t.category = k.category"
+		      << " AND t.number = k.number AND t.type_of_statistical_processing = k.type_of_statistical_processing)"
+		      << " JOIN param p ON (p.id = t.param_id)"
+		      << " ORDER BY k.idx";
+
+		const auto templates = BatchQuery(query.str());
+		rows.insert(templates.begin(), templates.end());
+	}
+
+	for (const auto& miss : misses)
+	{
+		const auto& k = keys[miss.second[0]];
+		const auto row = rows.find(miss.second[0]);
+
+		map<string, string> def;
+
+		if (row != rows.end())
+		{
+			def = ParameterGrib2Row(row->second, k.discipline, k.category, k.paramId, k.typeOfStatisticalProcessing);
+		}
+
+		paramgrib2info[miss.first] = def;
+
+		for (const auto i : miss.second)
+		{
+			ret[i] = def;
+		}
+	}
+
+	FMIDEBUG(cout << "DEBUG: GetParametersFromGrib2() resolved " << misses.size() << " keys, " << rows.size()
+	              << " found" << endl);
 
 	return ret;
 }
 
-vector<vector<string>> NFmiRadonDB::GetGridGeoms(const string& ref_prod, const string& analtime,
-                                                 const string& geom_name)
+vector<map<string, string>> NFmiRadonDB::GetParametersFromNetCDF(const vector<NFmiNetCDFParameterKey>& keys)
 {
-	auto prod_def = GetProducerDefinition(ref_prod);
-	return GetGridGeoms(std::stoi(prod_def["producer_id"]), analtime, geom_name);
-}
+	vector<map<string, string>> ret(keys.size());
+	map<string, vector<size_t>> misses;
 
-map<string, string> NFmiRadonDB::GetGeometryDefinition(const string& geom_name)
-{
-	if (geometryinfo.find(geom_name) != geometryinfo.end())
+	for (size_t i = 0; i < keys.size(); i++)
 	{
-		FMIDEBUG(cout << "DEBUG: GetGeometryDefinition() cache hit!" << endl);
+		const auto& k = keys[i];
+		const string key = NetCDFParameterKey(k.producerId, k.paramName, k.levelId, k.levelValue);
 
-		return geometryinfo[geom_name];
+		const auto it = paramnetcdfinfo.find(key);
+
+		if (it != paramnetcdfinfo.end())
+		{
+			ret[i] = it->second;
+		}
+		else
+		{
+			misses[key].push_back(i);
+		}
 	}
 
-	// find geom name corresponding id
+	if (misses.empty())
+	{
+		return ret;
+	}
 
 	stringstream query;
 
-	query.str("");
+	query << "SELECT k.idx, x.* FROM (VALUES ";
 
-	// First get the grid type, so we know from which table to fetch detailed
-	// information
+	for (auto it = misses.begin(); it != misses.end(); ++it)
+	{
+		const size_t i = it->second[0];
+		const auto& k = keys[i];
 
-	query << "SELECT id, name, projection_id FROM geom WHERE name = '" << geom_name << "'";
+		query << (it == misses.begin() ? "" : ",") << "(" << i << "," << k.producerId << "," << Quote(k.paramName)
+		      << "," << k.levelId << "," << k.levelValue << ")";
+	}
 
-	Query(query.str());
+	query << ") AS k(idx, producer_id, netcdf_name, level_id, level_value)"
+	      << " CROSS JOIN LATERAL ("
+	      << "SELECT p.id, p.name, 1 AS version, u.name AS unit_name, "
+	         "p.interpolation_id, i.name AS interpolation_name, "
+	         "g.level_id, g.level_value "
+	      << "FROM param_netcdf g, param p, param_unit u, interpolation_method i "
+	      << "WHERE g.param_id = p.id AND p.unit_id = u.id AND p.interpolation_id = i.id"
+	      << " AND g.producer_id = k.producer_id AND g.netcdf_name = k.netcdf_name"
+	      << " AND (g.level_id IS NULL OR g.level_id = k.level_id)"
+	      << " AND (g.level_value IS NULL OR g.level_value = k.level_value)"
+	      << " ORDER BY g.level_id NULLS LAST, g.level_value NULLS LAST LIMIT 1) x";
 
-	vector<string> row = FetchRow();
+	const auto rows = BatchQuery(query.str());
 
-	if (row.empty())
+	for (const auto& miss : misses)
 	{
-		return map<string, string>();
-	}
+		const auto row = rows.find(miss.second[0]);
 
-	map<string, string> ret;
+		if (row == rows.end())
+		{
+			// Not found is not cached, like in GetParameterFromNetCDF()
+			continue;
+		}
 
-	ret["id"] = row[0];
-	ret["name"] = row[1];
-	ret["grid_type_id"] = row[2];
+		const auto def = NetCDFParameterRow(row->second, keys[miss.second[0]].paramName);
 
-	int grid_type_id = std::stoi(row[2]);
+		paramnetcdfinfo[miss.first] = def;
 
-	query.str("");
+		for (const auto i : miss.second)
+		{
+			ret[i] = def;
+		}
+	}
 
-	switch (grid_type_id)
+	return ret;
+}
+
+vector<map<string, string>> NFmiRadonDB::GetParametersFromGeoTIFF(const vector<NFmiGeoTIFFParameterKey>& keys)
+{
+	vector<map<string, string>> ret(keys.size());
+	map<string, vector<size_t>> misses;
+
+	for (size_t i = 0; i < keys.size(); i++)
 	{
-		case 1:
+		const auto& k = keys[i];
+		const string key = to_string(k.producerId) + "_" + k.paramName;
+
+		const auto it = paramgeotiffinfo.find(key);
+
+		if (it != paramgeotiffinfo.end())
 		{
-			query << "SELECT ni, nj, first_lat, first_lon, di, dj, scanning_mode, earth_semi_major, earth_semi_minor, "
-			         "proj4, earth_ellipsoid_name FROM "
-			         "geom_latitude_longitude_v WHERE geometry_id = "
-			      << row[0];
-			Query(query.str());
-			row = FetchRow();
+			ret[i] = it->second;
+		}
+		else
+		{
+			misses[key].push_back(i);
+		}
+	}
 
-			if (row.empty())
-				return map<string, string>();
+	if (misses.empty())
+	{
+		return ret;
+	}
 
-			ret["ni"] = row[0];
-			ret["nj"] = row[1];
-			ret["first_point_lat"] = row[2];
-			ret["first_point_lon"] = row[3];
-			ret["di"] = row[4];
-			ret["dj"] = row[5];
-			ret["scanning_mode"] = row[6];
-			ret["col_cnt"] = ret["ni"];               // neons
-			ret["row_cnt"] = ret["nj"];               // neons
-			ret["pas_longitude"] = ret["di"];         // neons
-			ret["pas_latitude"] = ret["dj"];          // neons
-			ret["stor_desc"] = ret["scanning_mode"];  // neons
-			ret["geom_parm_1"] = "0";
-			ret["geom_parm_2"] = "0";
-			ret["geom_parm_3"] = "0";
-			ret["lat_orig"] = ret["first_point_lat"];   // neons
-			ret["long_orig"] = ret["first_point_lon"];  // neons
-			ret["earth_semi_major"] = row[7];
-			ret["earth_semi_minor"] = row[8];
-			ret["proj4"] = row[9];
-			ret["earth_ellipsoid_name"] = row[10];
+	stringstream query;
 
-			geometryinfo[geom_name] = ret;
+	query << "SELECT DISTINCT ON (k.idx) k.idx, p.id, p.name, 1 AS version, u.name AS unit_name, "
+	         "p.interpolation_id, i.name AS interpolation_name "
+	      << "FROM (VALUES ";
 
-			return ret;
-		}
+	for (auto it = misses.begin(); it != misses.end(); ++it)
+	{
+		const size_t i = it->second[0];
 
-		case 2:
+		query << (it == misses.begin() ? "" : ",") << "(" << i << "," << keys[i].producerId << ","
+		      << Quote(keys[i].paramName) << ")";
+	}
+
+	query << ") AS k(idx, producer_id, geotiff_name)"
+	      << " JOIN param_geotiff g ON (g.producer_id = k.producer_id AND g.geotiff_name = k.geotiff_name)"
+	      << " JOIN param p ON (g.param_id = p.id)"
+	      << " JOIN param_unit u ON (p.unit_id = u.id)"
+	      << " JOIN interpolation_method i ON (p.interpolation_id = i.id)"
+	      << " ORDER BY k.idx";
+
+	const auto rows = BatchQuery(query.str());
+
+	for (const auto& miss : misses)
+	{
+		const auto row = rows.find(miss.second[0]);
+
+		if (row == rows.end())
 		{
-			query << "SELECT ni, nj, first_lat, first_lon, di, dj, scanning_mode, "
-			         "orientation, earth_semi_major, earth_semi_minor, proj4, earth_ellipsoid_name";
+			continue;
+		}
 
-			if (RadonVersion() >= 20211021)
-			{
-				query << ",latin, lat_ts";
-			}
-			else
-			{
-				query << ",90, 60";
-			}
+		const auto def = GeoTIFFParameterRow(row->second, keys[miss.second[0]].paramName);
 
-			query << " FROM "
-			         "geom_stereographic_v WHERE "
-			         "geometry_id = "
-			      << row[0];
+		paramgeotiffinfo[miss.first] = def;
 
-			Query(query.str());
-			row = FetchRow();
+		for (const auto i : miss.second)
+		{
+			ret[i] = def;
+		}
+	}
 
-			if (row.empty())
-				return map<string, string>();
+	return ret;
+}
 
-			ret["ni"] = row[0];
-			ret["nj"] = row[1];
+map<string, string> NFmiRadonDB::GetParameterPrecision(const std::string& paramName)
+{
+	map<string, string> ret;
+
+	stringstream query;
+	query << "SELECT pp.id, pp.precision FROM param_precision pp, param p  WHERE p.name = '" << paramName
+	      << "' AND p.id = pp.param_id";
+
+	Query(query.str());
+
+	vector<string> row = FetchRow();
+
+	if (row.empty())
+	{
+		FMIDEBUG(cout << "DEBUG Parameter " << paramName << " not found\n");
+	}
+	else
+	{
+		ret["id"] = row[0];
+		ret["precision"] = row[1];
+	}
+
+	return ret;
+}
+
+string NFmiRadonDB::GetNewbaseNameFromUnivId(unsigned long univ_id)
+{
+	string ret;
+	stringstream q;
+
+	q << "SELECT p.name FROM param_newbase_name p WHERE p.univ_id = " << univ_id;
+	Query(q.str());
+
+	vector<string> row = FetchRow();
+	if (row.empty())
+	{
+		FMIDEBUG(cout << "DEBUG Parameter not found: " << univ_id << "\n");
+	}
+	else
+	{
+		ret = row[0];
+	}
+	return ret;
+}
+
+map<string, string> NFmiRadonDB::GetLevelFromDatabaseName(const std::string& name)
+{
+	if (levelnameinfo.find(name) != levelnameinfo.end())
+	{
+		FMIDEBUG(cout << "DEBUG: GetLevelFromDatabaseName() cache hit for " << name << endl);
+
+		return levelnameinfo[name];
+	}
+
+	stringstream query;
+
+	query << "SELECT id, name "
+	      << "FROM level "
+	      << " WHERE upper('" << name << "') = name ";
+
+	Query(query.str());
+
+	vector<string> row = FetchRow();
+
+	map<string, string> ret;
+
+	if (row.empty())
+	{
+		FMIDEBUG(cout << "DEBUG Level not found\n");
+	}
+	else
+	{
+		ret["id"] = row[0];
+		ret["name"] = row[1];
+
+		levelnameinfo[name] = ret;
+	}
+
+	return ret;
+}
+
+int NFmiRadonDB::GetGribLevelForProducer(long producerId, long levelId, long edition)
+{
+	const string key = to_string(producerId) + "_" + to_string(levelId) + "_" + to_string(edition);
+
+	if (levelinfo.find(key) != levelinfo.end())
+	{
+		FMIDEBUG(cout << "DEBUG: GetGribLevelForProducer() cache hit for " << key << endl);
+
+		return griblevelinfo[key];
+	}
+
+	stringstream query;
+
+	query << "SELECT grib_level_id FROM " << (edition == 2 ? "level_grib2 g " : "level_grib1 g")
+	      << " WHERE g.producer_id = " << producerId << " AND g.level_id = " << levelId;
+
+	Query(query.str());
+
+	vector<string> row = FetchRow();
+
+	int ret;
+
+	if (row.empty())
+	{
+		FMIDEBUG(cout << "DEBUG Level not found\n");
+		ret = -1;
+	}
+	else
+	{
+		ret = std::stoi(row[0]);
+		griblevelinfo[key] = ret;
+	}
+
+	return ret;
+}
+
+map<string, string> NFmiRadonDB::GetLevelFromGrib(long producerId, long levelNumber, long edition)
+{
+	const string key = to_string(producerId) + "_" + to_string(levelNumber) + "_" + to_string(edition);
+
+	if (levelinfo.find(key) != levelinfo.end())
+	{
+		FMIDEBUG(cout << "DEBUG: GetLevelFromGrib() cache hit for " << key << endl);
+
+		return levelinfo[key];
+	}
+
+	stringstream query;
+
+	query << "SELECT id, name "
+	      << "FROM level l, " << (edition == 2 ? "level_grib2 g " : "level_grib1 g") << " WHERE l.id = g.level_id "
+	      << " AND g.producer_id = " << producerId << " AND g.grib_level_id = " << levelNumber;
+
+	Query(query.str());
+
+	vector<string> row = FetchRow();
+
+	map<string, string> ret;
+
+	if (row.empty())
+	{
+		FMIDEBUG(cout << "DEBUG Level not found\n");
+	}
+	else
+	{
+		ret["id"] = row[0];
+		ret["name"] = row[1];
+		ret["grib1Number"] = to_string(levelNumber);
+
+		levelinfo[key] = ret;
+	}
+
+	return ret;
+}
+
+vector<vector<string>> NFmiRadonDB::GetGridGeoms(long producer_id, const string& analtime, const string& geom_name)
+{
+	GridAvailability* availability = Availability(producer_id, analtime);
+
+	if (availability)
+	{
+		const time_t t = AvailabilityTime(analtime);
+
+		vector<vector<string>> geoms;
+
+		for (const auto& id : availability->index.Find(t))
+		{
+			const auto& row = availability->rows[id];
+
+			// row: id, geometry_name, geometry_id, table_name, schema_name, partition_name, record_count, ...
+
+			if (row[2].empty() || row[6].empty() || stol(row[6]) <= 0 ||
+			    (!geom_name.empty() && row[1] != geom_name))
+			{
+				continue;
+			}
+
+			geoms.push_back({row[2], row[3], row[0], row[1], row[4], row[5]});
+		}
+
+		return geoms;
+	}
+
+	const string key = to_string(producer_id) + "_" + analtime + "_" + geom_name;
+
+	const int maxAge = refreshInterval;
+
+	if (maxAge > 0)
+	{
+		const ConnectionParameters params{user_, password_, database_, hostname_, port_};
+
+		return staleGridGeoms.Get(
+		    ConnectionKey() + "_" + key, chrono::seconds(maxAge),
+		    [&]()
+		    {
+			    return inflightGridGeoms.Do(
+			        ConnectionKey() + "_" + key, [&]() { return QueryGridGeoms(producer_id, analtime, geom_name); },
+			        OwnFailure());
+		    },
+		    [=]()
+		    {
+			    return Refreshed<vector<vector<string>>>(
+			        params, [=](NFmiRadonDB& db) { return db.QueryGridGeoms(producer_id, analtime, geom_name); });
+		    });
+	}
+
+	if (gridgeoms.count(key) > 0)
+	{
+		FMIDEBUG(cout << "DEBUG: GetGridGeoms() cache hit!" << endl);
+
+		return gridgeoms[key];
+	}
+
+	const auto ret = inflightGridGeoms.Do(
+	    ConnectionKey() + "_" + key, [&]() { return QueryGridGeoms(producer_id, analtime, geom_name); }, OwnFailure());
+
+	gridgeoms[key] = ret;
+
+	return ret;
+}
+
+vector<vector<string>> NFmiRadonDB::QueryGridGeoms(long producer_id, const string& analtime, const string& geom_name)
+{
+	stringstream query;
+
+	query << "SELECT g.geometry_id, a.table_name, a.id, "
+	         "g.geom_name, a.schema_name, a.partition_name"
+	      << " FROM as_grid_v a, fmi_producer f, geom_v g"
+	      << " WHERE a.record_count > 0"
+	      << " AND f.id = " << producer_id << " AND a.producer_id = f.id"
+	      << " AND (min_analysis_time, max_analysis_time) OVERLAPS ('" << analtime << "', '" << analtime << "')"
+	      << " AND a.geometry_name = g.geom_name";
+
+	if (!geom_name.empty())
+	{
+		query << " AND g.geom_name = '" << geom_name << "'";
+	}
+
+	Query(query.str());
+
+	vector<vector<string>> geoms;
+
+	while (true)
+	{
+		vector<string> values = FetchRow();
+
+		if (values.empty())
+		{
+			break;
+		}
+
+		geoms.push_back(values);
+	}
+
+	return geoms;
+}
+
+vector<vector<string>> NFmiRadonDB::GetGridGeoms(const string& ref_prod, const string& analtime,
+                                                 const string& geom_name)
+{
+	auto prod_def = GetProducerDefinition(ref_prod);
+	return GetGridGeoms(std::stoi(prod_def["producer_id"]), analtime, geom_name);
+}
+
+map<string, string> NFmiRadonDB::GetGeometryDefinition(const string& geom_name)
+{
+	if (geometryinfo.find(geom_name) != geometryinfo.end())
+	{
+		FMIDEBUG(cout << "DEBUG: GetGeometryDefinition() cache hit!" << endl);
+
+		return geometryinfo[geom_name];
+	}
+
+	if (itsGeometryPreload && !itsGeometriesPreloaded)
+	{
+		PreloadGeometries();
+
+		if (geometryinfo.find(geom_name) != geometryinfo.end())
+		{
+			return geometryinfo[geom_name];
+		}
+	}
+
+	const auto ret = inflightDefinitions.Do(
+	    ConnectionKey() + "_geom_" + geom_name,
+	    [&]()
+	    {
+		    // First get the grid type, so we know from which table to fetch detailed
+		    // information
+
+		    Query(GeometryQuery(geom_name));
+
+		    vector<string> row = FetchRow();
+
+		    if (row.empty())
+		    {
+			    return map<string, string>();
+		    }
+
+		    map<string, string> def;
+
+		    def["id"] = row[0];
+		    def["name"] = row[1];
+		    def["grid_type_id"] = row[2];
+
+		    const int grid_type_id = std::stoi(row[2]);
+		    const string query = GeometryDetailQuery(grid_type_id, row[0], grid_type_id == 2 ? RadonVersion() : 0);
+
+		    if (query.empty())
+		    {
+			    return map<string, string>();
+		    }
+
+		    Query(query);
+		    row = FetchRow();
+
+		    if (row.empty() || !GeometryDetailRow(grid_type_id, row, def))
+		    {
+			    return map<string, string>();
+		    }
+
+		    return def;
+	    },
+	    OwnFailure());
+
+	if (!ret.empty())
+	{
+		geometryinfo[geom_name] = ret;
+	}
+
+	return ret;
+}
+
+string NFmiRadonDB::GeometryListQuery()
+{
+	return "SELECT id, name, projection_id FROM geom";
+}
+
+/*
+ * PreloadGeometryRow()
+ *
+ * Stores one row of a projection view into geometryinfo if it belongs to a
+ * geometry of that projection in geoms (id -> id, name, projection_id).
+ */
+
+bool NFmiRadonDB::PreloadGeometryRow(int grid_type_id, const map<string, vector<string>>& geoms,
+                                     const vector<string>& row)
+{
+	const auto it = geoms.find(row[GeometryIdColumn(grid_type_id)]);
+
+	if (it == geoms.end() || stoi(it->second[2]) != grid_type_id)
+	{
+		return false;
+	}
+
+	map<string, string> def;
+
+	def["id"] = it->second[0];
+	def["name"] = it->second[1];
+	def["grid_type_id"] = it->second[2];
+
+	if (!GeometryDetailRow(grid_type_id, row, def))
+	{
+		return false;
+	}
+
+	geometryinfo[def["name"]] = def;
+
+	return true;
+}
+
+/*
+ * PreloadGeometries()
+ *
+ * Fills geometryinfo with all geometries: one query for the geometry list and
+ * one for each projection view in use, instead of two queries per geometry.
+ */
+
+void NFmiRadonDB::PreloadGeometries()
+{
+	Query(GeometryListQuery());
+
+	map<string, vector<string>> geoms;  // id -> id, name, projection_id
+	set<int> gridTypes;
+
+	while (true)
+	{
+		auto row = FetchRow();
+
+		if (row.empty())
+		{
+			break;
+		}
+
+		gridTypes.insert(stoi(row[2]));
+		geoms[row[0]] = move(row);
+	}
+
+	const int radon_version = gridTypes.count(2) ? RadonVersion() : 0;
+
+	size_t count = 0;
+
+	for (int grid_type_id : gridTypes)
+	{
+		const string query = GeometryDetailQuery(grid_type_id, "", radon_version);
+
+		if (query.empty())
+		{
+			continue;
+		}
+
+		Query(query);
+
+		while (true)
+		{
+			const auto row = FetchRow();
+
+			if (row.empty())
+			{
+				break;
+			}
+
+			if (PreloadGeometryRow(grid_type_id, geoms, row))
+			{
+				count++;
+			}
+		}
+	}
+
+	itsGeometriesPreloaded = true;
+
+	FMIDEBUG(cout << "DEBUG: PreloadGeometries() read " << count << " geometries" << endl);
+}
+
+/*
+ * GeometryQuery()
+ *
+ * Query builders and row parsers for GetGeometryDefinition(). Kept separate
+ * from the lookup so that they can be shared by the asynchronous version.
+ */
+
+string NFmiRadonDB::GeometryQuery(const string& geom_name)
+{
+	return "SELECT id, name, projection_id FROM geom WHERE name = '" + geom_name + "'";
+}
+
+string NFmiRadonDB::GeometryDetailQuery(int grid_type_id, const string& geometry_id, int radon_version)
+{
+	// geometry_id is selected last so that the same query serves both the single
+	// lookup and the bulk preload (empty geometry_id: all geometries of the view)
+
+	stringstream query;
+
+	switch (grid_type_id)
+	{
+		case 1:
+			query << "SELECT ni, nj, first_lat, first_lon, di, dj, scanning_mode, earth_semi_major, earth_semi_minor, "
+			         "proj4, earth_ellipsoid_name, geometry_id FROM "
+			         "geom_latitude_longitude_v";
+			break;
+
+		case 2:
+			query << "SELECT ni, nj, first_lat, first_lon, di, dj, scanning_mode, "
+			         "orientation, earth_semi_major, earth_semi_minor, proj4, earth_ellipsoid_name";
+
+			if (radon_version >= 20211021)
+			{
+				query << ",latin, lat_ts";
+			}
+			else
+			{
+				query << ",90, 60";
+			}
+
+			query << ", geometry_id FROM "
+			         "geom_stereographic_v";
+			break;
+
+		case 5:
+			query << "SELECT ni,nj, first_lat, first_lon, "
+			         "di, dj, scanning_mode, orientation, latin1, latin2, "
+			         "south_pole_lat, south_pole_lon, earth_semi_major, earth_semi_minor, proj4, earth_ellipsoid_name, "
+			         "geometry_id FROM "
+			         "geom_lambert_conformal_v";
+			break;
+
+		case 4:
+			query << "SELECT ni, nj, first_lat, first_lon, di, dj, scanning_mode, "
+			         "south_pole_lat, south_pole_lon, earth_semi_major, earth_semi_minor, proj4, earth_ellipsoid_name, "
+			         "geometry_id FROM "
+			         "geom_rotated_latitude_longitude_v";
+			break;
+
+		case 6:
+			query << "SELECT nj, first_lat, first_lon, last_lat, last_lon,"
+			         "n, scanning_mode, points_along_parallels, earth_semi_major, earth_semi_minor, proj4, "
+			         "earth_ellipsoid_name, geometry_id FROM "
+			         "geom_reduced_gaussian_v";
+			break;
+
+		case 7:
+			query << "SELECT ni,nj, first_lat, first_lon, "
+			         "di, dj, scanning_mode, orientation, latin, earth_semi_major, earth_semi_minor, proj4, "
+			         "earth_ellipsoid_name, geometry_id "
+			         "FROM geom_lambert_equal_area_v";
+			break;
+
+		case 8:
+			query << "SELECT ni,nj, first_lat, first_lon, "
+			         "di, dj, scanning_mode, orientation, latin, scale, earth_semi_major, earth_semi_minor, proj4, "
+			         "earth_ellipsoid_name, geometry_id "
+			         "FROM geom_transverse_mercator_v";
+			break;
+
+		default:
+			return "";
+	}
+
+	if (!geometry_id.empty())
+	{
+		query << " WHERE geometry_id = " << geometry_id;
+	}
+
+	return query.str();
+}
+
+// Position of geometry_id in the GeometryDetailQuery() columns. Not the last
+// element of the row: FetchRow() appends an extra column for each NULL
+
+size_t NFmiRadonDB::GeometryIdColumn(int grid_type_id)
+{
+	switch (grid_type_id)
+	{
+		case 1:
+			return 11;
+		case 2:
+			return 14;
+		case 4:
+			return 13;
+		case 5:
+			return 16;
+		case 6:
+			return 12;
+		case 7:
+			return 13;
+		case 8:
+			return 14;
+		default:
+			throw runtime_error("Unsupported grid type: " + to_string(grid_type_id));
+	}
+}
+
+bool NFmiRadonDB::GeometryDetailRow(int grid_type_id, const vector<string>& row, map<string, string>& ret)
+{
+	switch (grid_type_id)
+	{
+		case 1:
+		{
+			ret["ni"] = row[0];
+			ret["nj"] = row[1];
+			ret["first_point_lat"] = row[2];
+			ret["first_point_lon"] = row[3];
+			ret["di"] = row[4];
+			ret["dj"] = row[5];
+			ret["scanning_mode"] = row[6];
+			ret["col_cnt"] = ret["ni"];               // neons
+			ret["row_cnt"] = ret["nj"];               // neons
+			ret["pas_longitude"] = ret["di"];         // neons
+			ret["pas_latitude"] = ret["dj"];          // neons
+			ret["stor_desc"] = ret["scanning_mode"];  // neons
+			ret["geom_parm_1"] = "0";
+			ret["geom_parm_2"] = "0";
+			ret["geom_parm_3"] = "0";
+			ret["lat_orig"] = ret["first_point_lat"];   // neons
+			ret["long_orig"] = ret["first_point_lon"];  // neons
+			ret["earth_semi_major"] = row[7];
+			ret["earth_semi_minor"] = row[8];
+			ret["proj4"] = row[9];
+			ret["earth_ellipsoid_name"] = row[10];
+
+			return true;
+		}
+
+		case 2:
+		{
+			ret["ni"] = row[0];
+			ret["nj"] = row[1];
 			ret["first_point_lat"] = row[2];
 			ret["first_point_lon"] = row[3];
 			ret["di"] = row[4];
@@ -1160,443 +2152,887 @@ map<string, string> NFmiRadonDB::GetGeometryDefinition(const string& geom_name)
 			ret["latin"] = row[12];
 			ret["lat_ts"] = row[13];
 
-			geometryinfo[geom_name] = ret;
+			return true;
+		}
+		case 5:
+			ret["ni"] = row[0];
+			ret["nj"] = row[1];
+			ret["first_point_lat"] = row[2];
+			ret["first_point_lon"] = row[3];
+			ret["di"] = row[4];
+			ret["dj"] = row[5];
+			ret["scanning_mode"] = row[6];
+			ret["orientation"] = row[7];
+			ret["latin1"] = row[8];
+			ret["latin2"] = row[9];
+			ret["south_pole_lat"] = row[10];
+			ret["south_pole_lon"] = row[11];
+			ret["earth_semi_major"] = row[12];
+			ret["earth_semi_minor"] = row[13];
+			ret["proj4"] = row[14];
+			ret["earth_ellipsoid_name"] = row[15];
+
+			return true;
+
+		case 4:
+		{
+			ret["ni"] = row[0];
+			ret["nj"] = row[1];
+			ret["first_point_lat"] = row[2];
+			ret["first_point_lon"] = row[3];
+			ret["di"] = row[4];
+			ret["dj"] = row[5];
+			ret["scanning_mode"] = row[6];
+			ret["col_cnt"] = ret["ni"];               // neons
+			ret["row_cnt"] = ret["nj"];               // neons
+			ret["pas_longitude"] = ret["di"];         // neons
+			ret["pas_latitude"] = ret["dj"];          // neons
+			ret["stor_desc"] = ret["scanning_mode"];  // neons
+			ret["geom_parm_1"] = row[7];
+			ret["geom_parm_2"] = row[8];
+			ret["geom_parm_3"] = "0";
+			ret["lat_orig"] = ret["first_point_lat"];   // neons
+			ret["long_orig"] = ret["first_point_lon"];  // neons
+			ret["earth_semi_major"] = row[9];
+			ret["earth_semi_minor"] = row[10];
+			ret["proj4"] = row[11];
+			ret["earth_ellipsoid_name"] = row[12];
+
+			return true;
+		}
+		case 6:
+		{
+			ret["nj"] = row[0];
+			ret["first_point_lat"] = row[1];
+			ret["first_point_lon"] = row[2];
+			ret["last_point_lat"] = row[3];
+			ret["last_point_lon"] = row[4];
+			ret["n"] = row[5];
+			ret["scanning_mode"] = row[6];
+			ret["longitudes_along_parallels"] = boost::trim_copy_if(row[7], boost::is_any_of("{}"));
+			ret["earth_semi_major"] = row[7];
+			ret["earth_semi_minor"] = row[8];
+			ret["proj4"] = row[9];
+			ret["earth_ellipsoid_name"] = row[10];
+
+			return true;
+		}
+
+		case 7:
+			ret["ni"] = row[0];
+			ret["nj"] = row[1];
+			ret["first_point_lat"] = row[2];
+			ret["first_point_lon"] = row[3];
+			ret["di"] = row[4];
+			ret["dj"] = row[5];
+			ret["scanning_mode"] = row[6];
+			ret["orientation"] = row[7];
+			ret["latin"] = row[8];
+			ret["earth_semi_major"] = row[9];
+			ret["earth_semi_minor"] = row[10];
+			ret["proj4"] = row[11];
+			ret["earth_ellipsoid_name"] = row[12];
+
+			return true;
+
+		case 8:
+			ret["ni"] = row[0];
+			ret["nj"] = row[1];
+			ret["first_point_lat"] = row[2];
+			ret["first_point_lon"] = row[3];
+			ret["di"] = row[4];
+			ret["dj"] = row[5];
+			ret["scanning_mode"] = row[6];
+			ret["orientation"] = row[7];
+			ret["latin"] = row[8];
+			ret["scale"] = row[9];
+			ret["earth_semi_major"] = row[10];
+			ret["earth_semi_minor"] = row[11];
+			ret["proj4"] = row[12];
+			ret["earth_ellipsoid_name"] = row[13];
+
+			return true;
+	}
+
+	return false;
+}
+
+map<string, string> NFmiRadonDB::GetGeometryDefinition(size_t ni, size_t nj, double lat, double lon, double di,
+                                                       double dj, int projectionId)
+{
+	string key = to_string(ni) + "_" + to_string(nj) + "_" + to_string(lat) + "_" + to_string(lon) + "_" +
+	             to_string(di) + "_" + to_string(dj) + "_" + to_string(projectionId);
+
+	if (geometryinfo_fromarea.find(key) != geometryinfo_fromarea.end())
+	{
+		FMIDEBUG(cout << "DEBUG: GetGeometryDefinition() cache hit!" << endl);
+
+		return geometryinfo_fromarea[key];
+	}
+
+	if (itsGeometryCatalog)
+	{
+		const auto ret = CatalogGeometry(ni, nj, lat, lon, di, dj, projectionId);
 
+		if (!ret.empty())
+		{
+			geometryinfo_fromarea[key] = ret;
 			return ret;
 		}
-		case 5:
-			query << "SELECT ni,nj, first_lat, first_lon, "
-			         "di, dj, scanning_mode, orientation, latin1, latin2, "
-			         "south_pole_lat, south_pole_lon, earth_semi_major, earth_semi_minor, proj4, earth_ellipsoid_name "
-			         "FROM "
-			         "geom_lambert_conformal_v WHERE geometry_id = "
-			      << row[0];
+	}
+
+	// TODO: for projections other than latlon, extra properties should be checked,
+	// such as south pole, orientation etc.
+
+	stringstream query;
+	stringstream lon_condition;
+	stringstream lat_condition;
+	stringstream di_condition;
+	stringstream dj_condition;
+
+	// Check three different conditions for longitude:
+	// a) argument and database are using same range
+	// b) argument is -180..180 and database is 0..360
+	// c) argument is 0..360 and database is -180..180
+
+	lon_condition << "(round(first_lon::numeric, 8) = round(" << setprecision(10) << lon
+	              << ", 8) OR round(first_lon::numeric, 8) = round(360 + " << lon
+	              << ", 8) OR round(first_lon::numeric + 360., 8) = round(" << lon << ", 8))";
+
+	lat_condition << "round(first_lat::numeric, 8) = round(" << setprecision(10) << lat << ", 8)";
+
+	// when comparing grid cell size, a small margin is added because sometimes
+	// precision is calculated up to limits of numerical precision
+
+	di_condition << setprecision(10) << "abs(di - " << di << ") < ";
+	dj_condition << setprecision(10) << "abs(dj - " << dj << ") < ";
+
+	switch (projectionId)
+	{
+		case 1:
+			di_condition << "0.0000001";
+			dj_condition << "0.0000001";
+			query << "SELECT geometry_id, geometry_name FROM geom_latitude_longitude_v "
+			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
+			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
+			break;
+		case 2:
+			di_condition << "0.01";
+			dj_condition << "0.01";
+			query << "SELECT geometry_id, geometry_name FROM geom_stereographic_v "
+			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
+			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
+			break;
+		case 4:
+			di_condition << "0.0000001";
+			dj_condition << "0.0000001";
+			query << "SELECT geometry_id, geometry_name FROM geom_rotated_latitude_longitude_v "
+			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
+			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
+			break;
+		case 5:
+			di_condition << "0.01";
+			dj_condition << "0.01";
+			query << "SELECT geometry_id, geometry_name FROM geom_lambert_conformal_v "
+			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
+			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
+			break;
+		case 6:
+			query << "SELECT geometry_id, geometry_name FROM geom_reduced_gaussian_v "
+			      << "WHERE nj = " << nj << " AND " << lon_condition.str() << " AND " << lat_condition.str();
+			break;
+		case 7:
+			di_condition << "0.01";
+			dj_condition << "0.01";
+			query << "SELECT geometry_id, geometry_name FROM geom_lambert_equal_area_v "
+			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
+			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
+			break;
+		case 8:
+			di_condition << "0.01";
+			dj_condition << "0.01";
+			query << "SELECT geometry_id, geometry_name FROM geom_transverse_mercator_v "
+			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
+			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
+			break;
+
+		default:
+			throw std::runtime_error("Unsupported database projection id: " + to_string(projectionId));
+	}
+
+	Query(query.str());
+
+	auto row = FetchRow();
+
+	map<string, string> ret;
+	if (!row.empty())
+	{
+		ret["id"] = row[0];
+		ret["name"] = row[1];
+
+		geometryinfo_fromarea[key] = ret;
+	}
+
+	return ret;
+}
+
+/*
+ * CatalogGeometry()
+ *
+ * Matches an area against the geometry catalog, reading the geometries of
+ * the projection on first use. Tolerances are those of the SQL query in
+ * GetGeometryDefinition(). Reduced gaussian grids are matched on nj and origin
+ * only. Returns an empty map if no geometry matches.
+ */
+
+map<string, string> NFmiRadonDB::CatalogGeometry(size_t ni, size_t nj, double lat, double lon, double di, double dj,
+                                                 int projectionId)
+{
+	string view;
+	double tolerance = 0.0000001;
+
+	switch (projectionId)
+	{
+		case 1:
+			view = "geom_latitude_longitude_v";
+			break;
+		case 2:
+			view = "geom_stereographic_v";
+			tolerance = 0.01;
+			break;
+		case 4:
+			view = "geom_rotated_latitude_longitude_v";
+			break;
+		case 5:
+			view = "geom_lambert_conformal_v";
+			tolerance = 0.01;
+			break;
+		case 6:
+			view = "geom_reduced_gaussian_v";
+			break;
+		case 7:
+			view = "geom_lambert_equal_area_v";
+			tolerance = 0.01;
+			break;
+		case 8:
+			view = "geom_transverse_mercator_v";
+			tolerance = 0.01;
+			break;
+		default:
+			return map<string, string>();
+	}
+
+	const bool gaussian = (projectionId == 6);
+
+	if (geometrycatalogprojections.count(projectionId) == 0)
+	{
+		if (gaussian)
+		{
+			Query("SELECT geometry_id, geometry_name, 0, nj, first_lat, first_lon, 0, 0 FROM " + view +
+			      " ORDER BY geometry_id");
+		}
+		else
+		{
+			Query("SELECT geometry_id, geometry_name, ni, nj, first_lat, first_lon, di, dj FROM " + view +
+			      " ORDER BY geometry_id");
+		}
+
+		// Read aside, so that a bad row does not leave the projection half loaded
+
+		map<tuple<int, size_t, size_t>, vector<GeometryArea>> areas;
+		size_t count = 0;
+
+		while (true)
+		{
+			const auto row = FetchRow();
+
+			if (row.empty())
+			{
+				break;
+			}
+
+			GeometryArea area;
+			area.id = row[0];
+			area.name = row[1];
+			area.first_lat = stod(row[4]);
+			area.first_lon = stod(row[5]);
+			area.di = row[6].empty() ? 0 : stod(row[6]);
+			area.dj = row[7].empty() ? 0 : stod(row[7]);
+
+			areas[make_tuple(projectionId, stoul(row[2]), stoul(row[3]))].push_back(area);
+			count++;
+		}
 
-			Query(query.str());
-			row = FetchRow();
+		for (auto& a : areas)
+		{
+			geometrycatalog[a.first] = move(a.second);
+		}
 
-			if (row.empty())
-				return map<string, string>();
+		geometrycatalogprojections.insert(projectionId);
 
-			ret["ni"] = row[0];
-			ret["nj"] = row[1];
-			ret["first_point_lat"] = row[2];
-			ret["first_point_lon"] = row[3];
-			ret["di"] = row[4];
-			ret["dj"] = row[5];
-			ret["scanning_mode"] = row[6];
-			ret["orientation"] = row[7];
-			ret["latin1"] = row[8];
-			ret["latin2"] = row[9];
-			ret["south_pole_lat"] = row[10];
-			ret["south_pole_lon"] = row[11];
-			ret["earth_semi_major"] = row[12];
-			ret["earth_semi_minor"] = row[13];
-			ret["proj4"] = row[14];
-			ret["earth_ellipsoid_name"] = row[15];
+		FMIDEBUG(cout << "DEBUG: Geometry catalog read " << count << " geometries from " << view << endl);
+	}
 
-			geometryinfo[geom_name] = ret;
+	const auto it = geometrycatalog.find(make_tuple(projectionId, gaussian ? 0 : ni, nj));
 
-			return ret;
+	if (it == geometrycatalog.end())
+	{
+		return map<string, string>();
+	}
 
-		case 4:
-		{
-			query << "SELECT ni, nj, first_lat, first_lon, di, dj, scanning_mode, "
-			         "south_pole_lat, south_pole_lon, earth_semi_major, earth_semi_minor, proj4, earth_ellipsoid_name "
-			         "FROM "
-			         "geom_rotated_latitude_longitude_v "
-			         "WHERE geometry_id = "
-			      << row[0];
-			Query(query.str());
-			row = FetchRow();
+	// Coordinates are rounded to 8 decimals in the SQL query
 
-			if (row.empty())
-				return map<string, string>();
+	const double kCoordinateEpsilon = 0.000000005;
 
-			ret["ni"] = row[0];
-			ret["nj"] = row[1];
-			ret["first_point_lat"] = row[2];
-			ret["first_point_lon"] = row[3];
-			ret["di"] = row[4];
-			ret["dj"] = row[5];
-			ret["scanning_mode"] = row[6];
-			ret["col_cnt"] = ret["ni"];               // neons
-			ret["row_cnt"] = ret["nj"];               // neons
-			ret["pas_longitude"] = ret["di"];         // neons
-			ret["pas_latitude"] = ret["dj"];          // neons
-			ret["stor_desc"] = ret["scanning_mode"];  // neons
-			ret["geom_parm_1"] = row[7];
-			ret["geom_parm_2"] = row[8];
-			ret["geom_parm_3"] = "0";
-			ret["lat_orig"] = ret["first_point_lat"];   // neons
-			ret["long_orig"] = ret["first_point_lon"];  // neons
-			ret["earth_semi_major"] = row[9];
-			ret["earth_semi_minor"] = row[10];
-			ret["proj4"] = row[11];
-			ret["earth_ellipsoid_name"] = row[12];
+	for (const auto& area : it->second)
+	{
+		// Longitude: same range, argument -180..180 and database 0..360, or vice versa
 
-			geometryinfo[geom_name] = ret;
+		const bool lonMatch = fabs(area.first_lon - lon) <= kCoordinateEpsilon ||
+		                      fabs(area.first_lon - (lon + 360)) <= kCoordinateEpsilon ||
+		                      fabs(area.first_lon + 360 - lon) <= kCoordinateEpsilon;
 
-			return ret;
+		if (!lonMatch || fabs(area.first_lat - lat) > kCoordinateEpsilon)
+		{
+			continue;
 		}
-		case 6:
+
+		if (!gaussian && (fabs(area.di - di) >= tolerance || fabs(area.dj - dj) >= tolerance))
 		{
-			query << "SELECT nj, first_lat, first_lon, last_lat, last_lon,"
-			         "n, scanning_mode, points_along_parallels, earth_semi_major, earth_semi_minor, proj4, "
-			         "earth_ellipsoid_name FROM "
-			         "geom_reduced_gaussian_v WHERE geometry_id = "
-			      << row[0];
-			Query(query.str());
-			row = FetchRow();
+			continue;
+		}
 
-			if (row.empty())
-				return map<string, string>();
+		map<string, string> ret;
+		ret["id"] = area.id;
+		ret["name"] = area.name;
 
-			ret["nj"] = row[0];
-			ret["first_point_lat"] = row[1];
-			ret["first_point_lon"] = row[2];
-			ret["last_point_lat"] = row[3];
-			ret["last_point_lon"] = row[4];
-			ret["n"] = row[5];
-			ret["scanning_mode"] = row[6];
-			ret["longitudes_along_parallels"] = boost::trim_copy_if(row[7], boost::is_any_of("{}"));
-			ret["earth_semi_major"] = row[7];
-			ret["earth_semi_minor"] = row[8];
-			ret["proj4"] = row[9];
-			ret["earth_ellipsoid_name"] = row[10];
+		return ret;
+	}
 
-			geometryinfo[geom_name] = ret;
+	return map<string, string>();
+}
 
-			return ret;
-		}
+map<string, string> NFmiRadonDB::GetGeometryDefinition(size_t ni, size_t nj, double lat, double lon, double di,
+                                                       double dj, int gribedition, int gridtype)
+{
+	stringstream query;
 
-		case 7:
-			query << "SELECT ni,nj, first_lat, first_lon, "
-			         "di, dj, scanning_mode, orientation, latin, earth_semi_major, earth_semi_minor, proj4, "
-			         "earth_ellipsoid_name "
-			         "FROM geom_lambert_equal_area_v WHERE geometry_id = "
-			      << row[0];
+	query << "SELECT id FROM projection WHERE grib" << gribedition << "_number = " << gridtype;
 
-			Query(query.str());
-			row = FetchRow();
+	Query(query.str());
 
-			if (row.empty())
-				return map<string, string>();
+	auto row = FetchRow();
 
-			ret["ni"] = row[0];
-			ret["nj"] = row[1];
-			ret["first_point_lat"] = row[2];
-			ret["first_point_lon"] = row[3];
-			ret["di"] = row[4];
-			ret["dj"] = row[5];
-			ret["scanning_mode"] = row[6];
-			ret["orientation"] = row[7];
-			ret["latin"] = row[8];
-			ret["earth_semi_major"] = row[9];
-			ret["earth_semi_minor"] = row[10];
-			ret["proj4"] = row[11];
-			ret["earth_ellipsoid_name"] = row[12];
+	map<string, string> ret;
 
-			geometryinfo[geom_name] = ret;
+	if (row.empty())
+	{
+		return ret;
+	}
 
-			return ret;
+	int projection_id = stoi(row[0]);
 
-		case 8:
-			query << "SELECT ni,nj, first_lat, first_lon, "
-			         "di, dj, scanning_mode, orientation, latin, scale, earth_semi_major, earth_semi_minor, proj4, "
-			         "earth_ellipsoid_name "
-			         "FROM geom_transverse_mercator_v WHERE geometry_id = "
-			      << row[0];
+	return GetGeometryDefinition(ni, nj, lat, lon, di, dj, projection_id);
+}
 
-			Query(query.str());
-			row = FetchRow();
+map<string, string> NFmiRadonDB::GetProducerDefinition(unsigned long producer_id)
+{
+	if (producerinfo.count(producer_id) > 0)
+	{
+		FMIDEBUG(cout << "DEBUG: GetProducerDefinition() cache hit!" << endl);
 
-			if (row.empty())
-				return map<string, string>();
+		return producerinfo[producer_id];
+	}
 
-			ret["ni"] = row[0];
-			ret["nj"] = row[1];
-			ret["first_point_lat"] = row[2];
-			ret["first_point_lon"] = row[3];
-			ret["di"] = row[4];
-			ret["dj"] = row[5];
-			ret["scanning_mode"] = row[6];
-			ret["orientation"] = row[7];
-			ret["latin"] = row[8];
-			ret["scale"] = row[9];
-			ret["earth_semi_major"] = row[10];
-			ret["earth_semi_minor"] = row[11];
-			ret["proj4"] = row[12];
-			ret["earth_ellipsoid_name"] = row[13];
+	const auto ret = inflightDefinitions.Do(ConnectionKey() + "_producer_" + to_string(producer_id),
+	                                        [&]()
+	                                        {
+		                                        Query(ProducerQuery(producer_id));
+
+		                                        const vector<string> row = FetchRow();
+
+		                                        return row.empty() ? map<string, string>() : ProducerRow(row);
+	                                        },
+	                                        OwnFailure());
+
+	if (!ret.empty())
+	{
+		producerinfo[producer_id] = ret;
+	}
+
+	return ret;
+}
+
+/*
+ * GetProducerDefinition(string)
+ *
+ * Retrieves producer definition from radon meta-tables.
+ *
+ *
+ */
+
+map<string, string> NFmiRadonDB::GetProducerDefinition(const string& producer_name)
+{
+	Query(ProducerIdQuery(producer_name));
+
+	vector<string> row = FetchRow();
+
+	if (!row.empty())
+	{
+		return GetProducerDefinition(std::stoul(row[0]));
+	}
+
+	map<string, string> empty;
+	return empty;
+}
+
+string NFmiRadonDB::ProducerQuery(unsigned long producer_id)
+{
+	stringstream query;
+
+	query << "SELECT f.id, f.name, f.class_id, g.centre, g.ident "
+	      << "FROM fmi_producer f "
+	      << "LEFT OUTER JOIN producer_grib g ON (f.id = g.producer_id) "
+	      << "WHERE f.id = " << producer_id;
+
+	return query.str();
+}
+
+string NFmiRadonDB::ProducerIdQuery(const string& producer_name)
+{
+	stringstream query;
+
+	query << "SELECT id "
+	      << "FROM fmi_producer"
+	      << " WHERE name = '" << producer_name << "'";
+
+	return query.str();
+}
+
+map<string, string> NFmiRadonDB::ProducerRow(const vector<string>& row)
+{
+	map<string, string> ret;
+
+	ret["producer_id"] = row[0];
+	ret["ref_prod"] = row[1];
+	ret["producer_class"] = row[2];
+	ret["model_id"] = row[4];
+	ret["ident_id"] = row[3];
+
+	return ret;
+}
+
+string NFmiRadonDB::GetLatestTime(const std::string& ref_prod, const std::string& geom_name, unsigned int offset)
+{
+	auto prod = GetProducerDefinition(ref_prod);
+	if (prod.empty())
+		return "";
+
+	return GetLatestTime(std::stoi(prod["producer_id"]), geom_name, offset);
+}
+
+string NFmiRadonDB::GetLatestTime(int producer_id, const std::string& geom_name, unsigned int offset)
+{
+	string ret;
+
+	if (CachedLatestTime(producer_id, geom_name, offset, ret))
+	{
+		return ret;
+	}
+
+	ret = QueryLatestTime(producer_id, geom_name, offset);
+
+	CacheLatestTime(producer_id, geom_name, offset, ret);
+
+	return ret;
+}
+
+/*
+ * CachedLatestTime()
+ *
+ * With RefreshInterval() > 0 looks the latest time up from the shared stale
+ * cache, queueing a refresh if it is stale. CacheLatestTime() stores a time
+ * read by the caller. Shared by GetLatestTime() and GetLatestTimeAsync().
+ */
+
+bool NFmiRadonDB::CachedLatestTime(int producer_id, const string& geom_name, unsigned int offset, string& theTime)
+{
+	const int maxAge = refreshInterval;
+
+	if (maxAge <= 0)
+	{
+		return false;
+	}
+
+	const ConnectionParameters params{user_, password_, database_, hostname_, port_};
+
+	return staleLatestTimes.Find(
+	    LatestTimeKey(producer_id, geom_name, offset), chrono::seconds(maxAge),
+	    [=]()
+	    {
+		    return Refreshed<string>(
+		        params, [=](NFmiRadonDB& db) { return db.QueryLatestTime(producer_id, geom_name, offset); });
+	    },
+	    theTime);
+}
+
+void NFmiRadonDB::CacheLatestTime(int producer_id, const string& geom_name, unsigned int offset, const string& theTime)
+{
+	if (refreshInterval > 0)
+	{
+		staleLatestTimes.Put(LatestTimeKey(producer_id, geom_name, offset), theTime);
+	}
+}
+
+string NFmiRadonDB::LatestTimeKey(int producer_id, const string& geom_name, unsigned int offset) const
+{
+	return ConnectionKey() + "_" + to_string(producer_id) + "_" + geom_name + "_" + to_string(offset);
+}
+
+string NFmiRadonDB::QueryLatestTime(int producer_id, const std::string& geom_name, unsigned int offset)
+{
+	// Served from the cached list of latest times if enabled
+
+	if (itsLatestTimeTTL > 0)
+	{
+		// Fetch a few extra times so that looping over offsets is one query
+
+		const unsigned int count = max(offset + 1, 10u);
+		const auto times = GetLatestTimes(producer_id, count, geom_name);
+		const auto it = times.find(geom_name);
+
+		if (it == times.end() || it->second.size() <= offset)
+		{
+			return "";
+		}
+
+		return it->second[offset];
+	}
+
+	// First check if we have grid or previ producer
+
+	auto prod = GetProducerDefinition(producer_id);
+
+	if (prod.empty())
+	{
+		return "";
+	}
 
-			geometryinfo[geom_name] = ret;
+	Query(LatestTimeQuery(producer_id, prod["producer_class"], geom_name, offset));
 
-			return ret;
+	auto row = FetchRow();
+
+	if (row.size() == 0)
+	{
+		return "";
 	}
 
-	return map<string, string>();
+	return row[0];
 }
 
-map<string, string> NFmiRadonDB::GetGeometryDefinition(size_t ni, size_t nj, double lat, double lon, double di,
-                                                       double dj, int projectionId)
+void NFmiRadonDB::RefreshInterval(int theSeconds)
 {
-	string key = to_string(ni) + "_" + to_string(nj) + "_" + to_string(lat) + "_" + to_string(lon) + "_" +
-	             to_string(di) + "_" + to_string(dj) + "_" + to_string(projectionId);
+	refreshInterval = theSeconds;
+}
 
-	if (geometryinfo_fromarea.find(key) != geometryinfo_fromarea.end())
+/*
+ * GetLatestTimes()
+ *
+ * One query for the count latest analysis times of each geometry, and over
+ * all geometries (key ""), with the same semantics as GetLatestTime() with
+ * offsets 0..count-1. With LatestTimeTTL() > 0 the result is cached for
+ * that many seconds; a cached result for a larger count serves a smaller one.
+ */
+
+map<string, vector<string>> NFmiRadonDB::GetLatestTimes(int producer_id, unsigned int count, const string& geom_name)
+{
+	map<string, vector<string>> ret;
+
+	if (CachedLatestTimes(producer_id, count, geom_name, ret))
 	{
-		FMIDEBUG(cout << "DEBUG: GetGeometryDefinition() cache hit!" << endl);
+		FMIDEBUG(cout << "DEBUG: GetLatestTimes() cache hit!" << endl);
 
-		return geometryinfo_fromarea[key];
+		return ret;
 	}
 
-	// TODO: for projections other than latlon, extra properties should be checked,
-	// such as south pole, orientation etc.
+	auto prod = GetProducerDefinition(producer_id);
 
-	stringstream query;
-	stringstream lon_condition;
-	stringstream lat_condition;
-	stringstream di_condition;
-	stringstream dj_condition;
+	if (prod.empty() || count == 0)
+	{
+		return ret;
+	}
 
-	// Check three different conditions for longitude:
-	// a) argument and database are using same range
-	// b) argument is -180..180 and database is 0..360
-	// c) argument is 0..360 and database is -180..180
+	Query(LatestTimesQuery(producer_id, prod["producer_class"], count, geom_name));
 
-	lon_condition << "(round(first_lon::numeric, 8) = round(" << setprecision(10) << lon
-	              << ", 8) OR round(first_lon::numeric, 8) = round(360 + " << lon
-	              << ", 8) OR round(first_lon::numeric + 360., 8) = round(" << lon << ", 8))";
+	while (true)
+	{
+		auto row = FetchRow();
 
-	lat_condition << "round(first_lat::numeric, 8) = round(" << setprecision(10) << lat << ", 8)";
+		if (row.empty())
+		{
+			break;
+		}
 
-	// when comparing grid cell size, a small margin is added because sometimes
-	// precision is calculated up to limits of numerical precision
+		ret[row[0]].push_back(row[1]);
+	}
 
-	di_condition << setprecision(10) << "abs(di - " << di << ") < ";
-	dj_condition << setprecision(10) << "abs(dj - " << dj << ") < ";
+	CacheLatestTimes(producer_id, count, geom_name, ret);
 
-	switch (projectionId)
-	{
-		case 1:
-			di_condition << "0.0000001";
-			dj_condition << "0.0000001";
-			query << "SELECT geometry_id, geometry_name FROM geom_latitude_longitude_v "
-			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
-			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
-			break;
-		case 2:
-			di_condition << "0.01";
-			dj_condition << "0.01";
-			query << "SELECT geometry_id, geometry_name FROM geom_stereographic_v "
-			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
-			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
-			break;
-		case 4:
-			di_condition << "0.0000001";
-			dj_condition << "0.0000001";
-			query << "SELECT geometry_id, geometry_name FROM geom_rotated_latitude_longitude_v "
-			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
-			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
-			break;
-		case 5:
-			di_condition << "0.01";
-			dj_condition << "0.01";
-			query << "SELECT geometry_id, geometry_name FROM geom_lambert_conformal_v "
-			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
-			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
-			break;
-		case 6:
-			query << "SELECT geometry_id, geometry_name FROM geom_reduced_gaussian_v "
-			      << "WHERE nj = " << nj << " AND " << lon_condition.str() << " AND " << lat_condition.str();
-			break;
-		case 7:
-			di_condition << "0.01";
-			dj_condition << "0.01";
-			query << "SELECT geometry_id, geometry_name FROM geom_lambert_equal_area_v "
-			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
-			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
-			break;
-		case 8:
-			di_condition << "0.01";
-			dj_condition << "0.01";
-			query << "SELECT geometry_id, geometry_name FROM geom_transverse_mercator_v "
-			      << "WHERE nj = " << nj << " AND ni = " << ni << " AND " << lon_condition.str() << " AND "
-			      << lat_condition.str() << " AND " << di_condition.str() << " AND " << dj_condition.str();
-			break;
+	return ret;
+}
 
-		default:
-			throw std::runtime_error("Unsupported database projection id: " + to_string(projectionId));
-	}
+/*
+ * CachedLatestTimes()
+ *
+ * With LatestTimeTTL() > 0 looks the latest times up from the latesttimes
+ * cache; CacheLatestTimes() stores times read by the caller. Shared by
+ * GetLatestTimes() and GetLatestTimeAsync().
+ */
 
-	Query(query.str());
+bool NFmiRadonDB::CachedLatestTimes(int producer_id, unsigned int count, const string& geom_name,
+                                    map<string, vector<string>>& theTimes)
+{
+	if (itsLatestTimeTTL <= 0)
+	{
+		return false;
+	}
 
-	auto row = FetchRow();
+	const auto it = latesttimes.find(to_string(producer_id) + "_" + geom_name);
 
-	map<string, string> ret;
-	if (!row.empty())
+	if (it == latesttimes.end() || time(nullptr) - it->second.fetched >= itsLatestTimeTTL || it->second.count < count)
 	{
-		ret["id"] = row[0];
-		ret["name"] = row[1];
+		return false;
+	}
 
-		geometryinfo_fromarea[key] = ret;
+	theTimes = it->second.times;
+
+	for (auto& geom : theTimes)
+	{
+		geom.second.resize(min(geom.second.size(), static_cast<size_t>(count)));
 	}
 
-	return ret;
+	return true;
 }
 
-map<string, string> NFmiRadonDB::GetGeometryDefinition(size_t ni, size_t nj, double lat, double lon, double di,
-                                                       double dj, int gribedition, int gridtype)
+void NFmiRadonDB::CacheLatestTimes(int producer_id, unsigned int count, const string& geom_name,
+                                   const map<string, vector<string>>& theTimes)
 {
-	stringstream query;
+	if (itsLatestTimeTTL <= 0)
+	{
+		return;
+	}
 
-	query << "SELECT id FROM projection WHERE grib" << gribedition << "_number = " << gridtype;
+	auto& cached = latesttimes[to_string(producer_id) + "_" + geom_name];
+	cached.fetched = time(nullptr);
+	cached.count = count;
+	cached.times = theTimes;
+}
 
-	Query(query.str());
+string NFmiRadonDB::LatestTimesQuery(int producer_id, const string& producer_class, unsigned int count,
+                                     const string& geom_name)
+{
+	const string asTableName = (producer_class == "3") ? "as_previ_v" : "as_grid_v";
 
-	auto row = FetchRow();
+	stringstream query;
 
-	map<string, string> ret;
+	query << "WITH a AS (SELECT geometry_name, analysis_time, partition_name FROM " << asTableName
+	      << " WHERE producer_id = " << producer_id << " AND record_count > 0";
 
-	if (row.empty())
+	if (!geom_name.empty())
 	{
-		return ret;
+		query << " AND geometry_name = '" << geom_name << "'";
 	}
 
-	int projection_id = stoi(row[0]);
+	query << " GROUP BY geometry_name, analysis_time, partition_name) "
+	      << "SELECT geometry_name, analysis_time FROM ("
+	      << "SELECT geometry_name, analysis_time::timestamp AS analysis_time, "
+	      << "row_number() OVER (PARTITION BY geometry_name ORDER BY analysis_time DESC) AS rn FROM a) g "
+	      << "WHERE rn <= " << count << " UNION ALL "
+	      << "SELECT '', analysis_time FROM ("
+	      << "SELECT analysis_time::timestamp AS analysis_time, "
+	      << "row_number() OVER (ORDER BY analysis_time DESC) AS rn "
+	      << "FROM (SELECT DISTINCT analysis_time, partition_name FROM a) d) t "
+	      << "WHERE rn <= " << count << " ORDER BY 1, 2 DESC";
 
-	return GetGeometryDefinition(ni, nj, lat, lon, di, dj, projection_id);
+	return query.str();
 }
 
-map<string, string> NFmiRadonDB::GetProducerDefinition(unsigned long producer_id)
+string NFmiRadonDB::LatestTimeQuery(int producer_id, const string& producer_class, const string& geom_name,
+                                    unsigned int offset)
 {
-	if (producerinfo.count(producer_id) > 0)
-	{
-		FMIDEBUG(cout << "DEBUG: GetProducerDefinition() cache hit!" << endl);
+	string asTableName = "as_grid_v";
 
-		return producerinfo[producer_id];
+	if (producer_class == "3")
+	{
+		asTableName = "as_previ_v";
 	}
 
 	stringstream query;
 
-	query << "SELECT f.id, f.name, f.class_id, g.centre, g.ident "
-	      << "FROM fmi_producer f "
-	      << "LEFT OUTER JOIN producer_grib g ON (f.id = g.producer_id) "
-	      << "WHERE f.id = " << producer_id;
-
-	map<string, string> ret;
-
-	Query(query.str());
-
-	vector<string> row = FetchRow();
+	query << "SELECT analysis_time::timestamp FROM " << asTableName << " WHERE producer_id = " << producer_id
+	      << " AND record_count > 0 ";
 
-	if (!row.empty())
+	if (!geom_name.empty())
 	{
-		ret["producer_id"] = row[0];
-		ret["ref_prod"] = row[1];
-		ret["producer_class"] = row[2];
-		ret["model_id"] = row[4];
-		ret["ident_id"] = row[3];
-
-		producerinfo[producer_id] = ret;
+		query << " AND geometry_name = '" << geom_name << "'";
 	}
 
-	return ret;
+	query << " GROUP BY analysis_time, partition_name "
+	      << " ORDER BY analysis_time DESC LIMIT 1 OFFSET " << offset;
+
+	return query.str();
 }
 
-/*
- * GetProducerDefinition(string)
- *
- * Retrieves producer definition from radon meta-tables.
- *
- *
- */
+map<string, string> NFmiRadonDB::GetStationDefinition(FmiRadonStationNetwork networkType, unsigned long stationId,
+                                                      bool aggressive_cache)
+{
+	return GetStationDefinition(networkType, to_string(stationId), aggressive_cache);
+}
 
-map<string, string> NFmiRadonDB::GetProducerDefinition(const string& producer_name)
+map<string, string> NFmiRadonDB::GetStationDefinition(FmiRadonStationNetwork networkType, const string& stationId,
+                                                      bool aggressive_cache)
 {
+	string key = to_string(static_cast<int>(networkType)) + "_" + stationId;
+
+	if (stationinfo.find(key) != stationinfo.end())
+		return stationinfo[key];
+
+	// Aggressive mode reads all stations of all networks once, any identifier
+	// of a station then gives the same record. Once read, the catalog answers
+	// non-aggressive lookups too
+
+	if ((aggressive_cache || itsStationCatalogLoaded) && networkType >= kWMONetwork && networkType <= kFmiSIDNetwork)
+	{
+		if (!itsStationCatalogLoaded)
+		{
+			LoadStationCatalog();
+		}
+
+		return CatalogStation(networkType, stationId);
+	}
+
 	stringstream query;
 
-	query << "SELECT id "
-	      << "FROM fmi_producer"
-	      << " WHERE name = '" << producer_name << "'";
+	query << StationQuery(networkType);
 
-	Query(query.str());
+	if (!aggressive_cache)
+	{
+		query << " AND m.local_station_id = " << Quote(stationId) << ")";
+	}
+	else
+	{
+		query << ")";
+	}
 
-	vector<string> row = FetchRow();
+	Query(query.str());
 
-	if (!row.empty())
+	while (true)
 	{
-		return GetProducerDefinition(std::stoul(row[0]));
+		auto row = FetchRow();
+
+		if (row.empty())
+		{
+			break;
+		}
+
+		CacheStation(row);
 	}
 
-	map<string, string> empty;
-	return empty;
+	if (stationinfo.find(key) != stationinfo.end())
+		return stationinfo[key];
+
+	return map<string, string>();
 }
 
-string NFmiRadonDB::GetLatestTime(const std::string& ref_prod, const std::string& geom_name, unsigned int offset)
+/*
+ * GetStationDefinitions()
+ *
+ * Batch version of GetStationDefinition(). Stations that are not in cache
+ * are resolved with one query per network, and all found stations are
+ * added to cache. Results are in the order of the input; an empty map
+ * means the station was not found.
+ */
+
+vector<map<string, string>> NFmiRadonDB::GetStationDefinitions(
+    const vector<pair<FmiRadonStationNetwork, string>>& stations)
 {
-	auto prod = GetProducerDefinition(ref_prod);
-	if (prod.empty())
-		return "";
+	vector<map<string, string>> ret(stations.size());
+	map<FmiRadonStationNetwork, set<string>> misses;
 
-	return GetLatestTime(std::stoi(prod["producer_id"]), geom_name, offset);
-}
+	for (const auto& station : stations)
+	{
+		const string key = to_string(static_cast<int>(station.first)) + "_" + station.second;
 
-string NFmiRadonDB::GetLatestTime(int producer_id, const std::string& geom_name, unsigned int offset)
-{
-	// First check if we have grid or previ producer
+		const bool cataloged =
+		    itsStationCatalogLoaded && station.first >= kWMONetwork && station.first <= kFmiSIDNetwork;
 
-	auto prod = GetProducerDefinition(producer_id);
+		if (stationinfo.find(key) == stationinfo.end() && !cataloged)
+		{
+			misses[station.first].insert(station.second);
+		}
+	}
 
-	if (prod.empty())
+	for (const auto& network : misses)
 	{
-		return "";
-	}
+		stringstream query;
 
-	string asTableName = "as_grid_v";
-	string partitioningType;
+		query << StationQuery(network.first) << " AND m.local_station_id = ANY(ARRAY[";
 
-	stringstream query;
+		for (auto it = network.second.begin(); it != network.second.end(); ++it)
+		{
+			query << (it == network.second.begin() ? "" : ",") << Quote(*it);
+		}
 
-	if (prod["producer_class"] == "3")
-	{
-		asTableName = "as_previ_v";
-		partitioningType = "ANALYSISTIME";
-	}
+		query << "]::text[]))";
+
+		Query(query.str());
 
-	query.str("");
+		size_t found = 0;
 
-	query << "SELECT analysis_time::timestamp FROM " << asTableName << " WHERE producer_id = " << producer_id
-	      << " AND record_count > 0 ";
+		while (true)
+		{
+			auto row = FetchRow();
 
-	if (!geom_name.empty())
-	{
-		query << " AND geometry_name = '" << geom_name << "'";
+			if (row.empty())
+			{
+				break;
+			}
+
+			CacheStation(row);
+			found++;
+		}
+
+		FMIDEBUG(cout << "DEBUG: GetStationDefinitions() network " << static_cast<int>(network.first) << ": "
+		              << network.second.size() << " requested, " << found << " found" << endl);
 	}
 
-	query << " GROUP BY analysis_time, partition_name "
-	      << " ORDER BY analysis_time DESC LIMIT 1 OFFSET " << offset;
+	for (size_t i = 0; i < stations.size(); i++)
+	{
+		const string key = to_string(static_cast<int>(stations[i].first)) + "_" + stations[i].second;
+		const auto it = stationinfo.find(key);
 
-	Query(query.str());
+		if (it != stationinfo.end())
+		{
+			ret[i] = it->second;
+			continue;
+		}
 
-	auto row = FetchRow();
+		// From the station catalog, if it has been loaded
 
-	if (row.size() == 0)
-	{
-		return "";
+		ret[i] = CatalogStation(stations[i].first, stations[i].second);
 	}
 
-	return row[0];
+	return ret;
 }
 
-map<string, string> NFmiRadonDB::GetStationDefinition(FmiRadonStationNetwork networkType, unsigned long stationId,
-                                                      bool aggressive_cache)
+string NFmiRadonDB::StationQuery(FmiRadonStationNetwork networkType)
 {
-	string key = to_string(static_cast<int>(networkType)) + "_" + to_string(stationId);
-
-	if (stationinfo.find(key) != stationinfo.end())
-		return stationinfo[key];
+	return StationCatalogQuery() + "JOIN station_network_mapping m ON (s.id = m.station_id AND m.network_id = " +
+	       to_string(static_cast<int>(networkType));
+}
 
+string NFmiRadonDB::StationCatalogQuery()
+{
 	stringstream query;
 
 	query << "SELECT s.id,"
@@ -1619,20 +3055,71 @@ map<string, string> NFmiRadonDB::GetStationDefinition(FmiRadonStationNetwork net
 	      << "LEFT OUTER JOIN station_network_mapping rw ON (s.id = "
 	         "rw.station_id AND rw.network_id = 4) "
 	      << "LEFT OUTER JOIN station_network_mapping fs ON (s.id = "
-	         "fs.station_id AND fs.network_id = 5) "
-	      << "JOIN station_network_mapping m ON (s.id = m.station_id AND m.network_id = "
-	      << static_cast<int>(networkType);
+	         "fs.station_id AND fs.network_id = 5) ";
 
-	if (!aggressive_cache)
-	{
-		query << " AND m.local_station_id = '" << stationId << "')";
-	}
-	else
+	return query.str();
+}
+
+map<string, string> NFmiRadonDB::StationRow(const vector<string>& row)
+{
+	map<string, string> stat;
+
+	stat["id"] = row[0];
+	stat["station_name"] = row[1];
+	stat["longitude"] = row[2];
+	stat["latitude"] = row[3];
+	stat["altitude"] = row[4];
+	stat["wmoid"] = row[5];
+	stat["icaoid"] = row[6];
+	stat["lpnn"] = row[7];
+	stat["rwid"] = row[8];
+	stat["fmisid"] = row[9];
+
+	return stat;
+}
+
+/*
+ * CacheStation()
+ *
+ * Stores a station row under every identifier it has, so that a later lookup
+ * of the station from any network is a cache hit.
+ */
+
+void NFmiRadonDB::CacheStation(const vector<string>& row)
+{
+	const auto stat = StationRow(row);
+
+	const char* fields[] = {"", "wmoid", "icaoid", "lpnn", "rwid", "fmisid"};
+
+	for (int network = kWMONetwork; network <= kFmiSIDNetwork; network++)
 	{
-		query << ")";
+		const string& localId = stat.at(fields[network]);
+
+		if (!localId.empty())
+		{
+			stationinfo[to_string(network) + "_" + localId] = stat;
+		}
 	}
+}
 
-	Query(query.str());
+/*
+ * LoadStationCatalog()
+ *
+ * Reads all stations with one query into a catalog with one record per
+ * station, indexed by the identifiers of the station in every network, and
+ * builds the spatial indexes used by the nearest station queries: one over
+ * all stations and one for each network, for the stations that belong to it.
+ */
+
+void NFmiRadonDB::LoadStationCatalog()
+{
+	Query(StationCatalogQuery());
+
+	stationcatalog.clear();
+	stationids.clear();
+	stationindexes.clear();
+
+	map<string, size_t> positions;  // radon station id -> catalog position
 
 	while (true)
 	{
@@ -1643,49 +3130,133 @@ map<string, string> NFmiRadonDB::GetStationDefinition(FmiRadonStationNetwork net
 			break;
 		}
 
-		map<string, string> stat;
+		// A station with several identifiers in one network comes in several rows
+
+		auto it = positions.find(row[0]);
+
+		if (it == positions.end())
+		{
+			it = positions.emplace(row[0], stationcatalog.size()).first;
+			stationcatalog.push_back(StationRow(row));
+		}
+
+		// Columns 5..9 are the identifiers in networks 1..5
+
+		for (int network = kWMONetwork; network <= kFmiSIDNetwork; network++)
+		{
+			if (!row[4 + network].empty())
+			{
+				stationids.emplace(to_string(network) + "_" + row[4 + network], it->second);
+			}
+		}
+	}
 
-		stat["id"] = row[0];
-		stat["station_name"] = row[1];
-		stat["longitude"] = row[2];
-		stat["latitude"] = row[3];
-		stat["altitude"] = row[4];
-		stat["wmoid"] = row[5];
-		stat["icaoid"] = row[6];
-		stat["lpnn"] = row[7];
-		stat["rwid"] = row[8];
-		stat["fmisid"] = row[9];
+	const char* fields[] = {"", "wmoid", "icaoid", "lpnn", "rwid", "fmisid"};
 
-		string localId;
+	for (size_t pos = 0; pos < stationcatalog.size(); pos++)
+	{
+		const auto& stat = stationcatalog[pos];
 
-		switch (networkType)
+		if (stat.at("latitude").empty() || stat.at("longitude").empty())
 		{
-			default:
-			case kWMONetwork:
-				localId = stat["wmoid"];
-				break;
-			case kICAONetwork:
-				localId = stat["icaoid"];
-				break;
-			case kLPNNNetwork:
-				localId = stat["lpnn"];
-				break;
-			case kRoadWeatherNetwork:
-				localId = stat["rwid"];
-				break;
-			case kFmiSIDNetwork:
-				localId = stat["fmisid"];
-				break;
+			continue;
 		}
 
-		string key = to_string(static_cast<int>(networkType)) + "_" + localId;
-		stationinfo[key] = stat;
+		const double lat = stod(stat.at("latitude"));
+		const double lon = stod(stat.at("longitude"));
+
+		stationindexes[kUnknownNetwork].Insert(pos, lat, lon);
+
+		for (int network = kWMONetwork; network <= kFmiSIDNetwork; network++)
+		{
+			if (!stat.at(fields[network]).empty())
+			{
+				stationindexes[network].Insert(pos, lat, lon);
+			}
+		}
 	}
 
-	if (stationinfo.find(key) != stationinfo.end())
-		return stationinfo[key];
+	itsStationCatalogLoaded = true;
 
-	return map<string, string>();
+	FMIDEBUG(cout << "DEBUG: Station catalog has " << stationcatalog.size() << " stations" << endl);
+}
+
+/*
+ * CatalogStation()
+ *
+ * Station record of the catalog by network and local id. The record is
+ * shared by all identifiers of the station, so for a station with several
+ * identifiers in the network the identifier field is set to the requested
+ * one, as in the row that a query by that identifier returns.
+ */
+
+map<string, string> NFmiRadonDB::CatalogStation(FmiRadonStationNetwork networkType, const string& stationId)
+{
+	const auto it = stationids.find(to_string(static_cast<int>(networkType)) + "_" + stationId);
+
+	if (it == stationids.end())
+	{
+		return map<string, string>();
+	}
+
+	const char* fields[] = {"", "wmoid", "icaoid", "lpnn", "rwid", "fmisid"};
+
+	auto ret = stationcatalog[it->second];
+	ret[fields[networkType]] = stationId;
+
+	return ret;
+}
+
+vector<pair<size_t, double>> NFmiRadonDB::NearestStations(double latitude, double longitude, size_t count,
+                                                          double maxDistance, FmiRadonStationNetwork networkType)
+{
+	if (!itsStationCatalogLoaded)
+	{
+		LoadStationCatalog();
+	}
+
+	const auto it = stationindexes.find(networkType);
+
+	if (it == stationindexes.end())
+	{
+		return vector<pair<size_t, double>>();
+	}
+
+	return it->second.Nearest(latitude, longitude, count, maxDistance);
+}
+
+vector<pair<unsigned long, double>> NFmiRadonDB::GetNearestStationIds(double latitude, double longitude, size_t count,
+                                                                      double maxDistance,
+                                                                      FmiRadonStationNetwork networkType)
+{
+	const auto nearest = NearestStations(latitude, longitude, count, maxDistance, networkType);
+
+	vector<pair<unsigned long, double>> ret;
+	ret.reserve(nearest.size());
+
+	for (const auto& station : nearest)
+	{
+		ret.push_back(make_pair(stoul(stationcatalog[station.first].at("id")), station.second));
+	}
+
+	return ret;
+}
+
+vector<map<string, string>> NFmiRadonDB::GetNearestStations(double latitude, double longitude, size_t count,
+                                                            double maxDistance, FmiRadonStationNetwork networkType)
+{
+	const auto nearest = NearestStations(latitude, longitude, count, maxDistance, networkType);
+
+	vector<map<string, string>> ret;
+	ret.reserve(nearest.size());
+
+	for (const auto& station : nearest)
+	{
+		ret.push_back(stationcatalog[station.first]);
+		ret.back()["distance"] = to_string(station.second);
+	}
+
+	return ret;
 }
 
 std::map<string, string> NFmiRadonDB::GetLevelTransform(long producer_id, long param_id, long fmi_level_id,
@@ -1729,77 +3300,263 @@ std::map<string, string> NFmiRadonDB::GetLevelTransform(long producer_id, long p
 	ret["name"] = row[1];
 	ret["value"] = row[2];
 
-	leveltransforminfo[key] = ret;
+	leveltransforminfo[key] = ret;
+
+	return ret;
+}
+
+std::string NFmiRadonDB::GetProducerMetaData(long producer_id, const string& attribute)
+{
+	string key = to_string(producer_id) + "_" + attribute;
+
+	if (producermetadatainfo.find(key) != producermetadatainfo.end())
+	{
+		FMIDEBUG(cout << "DEBUG: GetProducerMetaData() cache hit!" << endl);
+
+		return producermetadatainfo[key];
+	}
+
+	string query = "SELECT value FROM producer_meta WHERE producer_id = " + to_string(producer_id) +
+	               " AND attribute = '" + attribute + "'";
+
+	Query(query);
+
+	auto row = FetchRow();
+
+	if (row.empty())
+	{
+		return "";
+	}
+
+	producermetadatainfo[key] = row[0];
+	return row[0];
+}
+
+map<string, string> NFmiRadonDB::GetTableName(long producerId, const string& analysisTime, const string& geomName)
+{
+	GridAvailability* availability = Availability(producerId, analysisTime);
+
+	if (availability)
+	{
+		map<string, string> ret;
+
+		const auto it = availability->tables.find(make_pair(AvailabilityTime(analysisTime), geomName));
+
+		if (it == availability->tables.end())
+		{
+			return ret;
+		}
+
+		const auto& row = availability->rows[it->second];
+
+		ret["id"] = row[0];
+		ret["schema_name"] = row[4];
+		ret["table_name"] = row[3];
+		ret["partition_name"] = row[5];
+		ret["record_count"] = row[6];
+		ret["delete_time"] = row[7];
+
+		return ret;
+	}
+
+	const string key = to_string(producerId) + "_" + analysisTime + "_" + geomName;
+
+	if (tablenameinfo.find(key) != tablenameinfo.end())
+	{
+		FMIDEBUG(cout << "DEBUG: GetTableName() cache hit!" << endl);
+		return tablenameinfo[key];
+	}
+
+	stringstream ss;
+
+	ss << "SELECT "
+	   << "id, schema_name, table_name, partition_name, record_count, delete_time "
+	   << "FROM as_grid_v "
+	   << "WHERE geometry_name = '" << geomName << "'"
+	   << " AND analysis_time = to_timestamp('" << analysisTime << "', 'YYYY-MM-DD HH24:MI:SS')"
+	   << " AND producer_id = " << producerId;
+
+	Query(ss.str());
+
+	const auto row = FetchRow();
+
+	map<string, string> ret;
+
+	if (row.empty())
+	{
+		return ret;
+	}
+
+	ret["id"] = row[0];
+	ret["schema_name"] = row[1];
+	ret["table_name"] = row[2];
+	ret["partition_name"] = row[3];
+	ret["record_count"] = row[4];
+	ret["delete_time"] = row[5];
+
+	tablenameinfo[key] = ret;
+	return ret;
+}
+
+/*
+ * LoadGridAvailability()
+ *
+ * Reads the as_grid_v rows of a producer for analysis times between theStart
+ * and theEnd into an interval index over (min_analysis_time,
+ * max_analysis_time). GetGridGeoms() and GetTableName() are then answered from
+ * memory for times in the range. The whole range is read again every
+ * AvailabilityRefresh() seconds and replaces the earlier rows, so that new
+ * analysis times, late rows of older ones, changed record counts and rows
+ * removed by retention are all seen.
+ */
+
+void NFmiRadonDB::LoadGridAvailability(long producer_id, const string& theStart, const string& theEnd)
+{
+	auto& availability = gridavailability[producer_id];
+
+	availability.start = AvailabilityTime(theStart);
+	availability.end = AvailabilityTime(theEnd);
+	availability.newest = 0;
+	availability.refreshed = 0;
+	availability.rows.clear();
+	availability.index.Clear();
+	availability.tables.clear();
+
+	ReadGridAvailability(producer_id, availability);
+}
+
+void NFmiRadonDB::ReadGridAvailability(long producer_id, GridAvailability& availability)
+{
+	stringstream query;
+
+	query << "SELECT a.id, a.geometry_name, g.geometry_id, a.table_name, a.schema_name, a.partition_name, "
+	         "a.record_count, a.delete_time, "
+	         "extract(epoch from a.analysis_time)::bigint, "
+	         "extract(epoch from a.min_analysis_time)::bigint, "
+	         "extract(epoch from a.max_analysis_time)::bigint "
+	      << "FROM as_grid_v a LEFT OUTER JOIN geom_v g ON (a.geometry_name = g.geom_name) "
+	      << "WHERE a.producer_id = " << producer_id << " AND ((a.min_analysis_time <= to_timestamp("
+	      << availability.end << ") AT TIME ZONE 'UTC' AND a.max_analysis_time >= to_timestamp(" << availability.start
+	      << ") AT TIME ZONE 'UTC') OR a.analysis_time BETWEEN to_timestamp(" << availability.start
+	      << ") AT TIME ZONE 'UTC' AND to_timestamp(" << availability.end << ") AT TIME ZONE 'UTC')";
+
+	Query(query.str());
+
+	// Built aside and swapped in, so that a failed read leaves the earlier index in place
+
+	GridAvailability fresh;
+
+	fresh.start = availability.start;
+	fresh.end = availability.end;
+	fresh.newest = 0;
+
+	while (true)
+	{
+		auto row = FetchRow();
+
+		if (row.empty())
+		{
+			break;
+		}
+
+		if (!row[8].empty())
+		{
+			const time_t analysis_time = stoll(row[8]);
+
+			fresh.newest = max(fresh.newest, analysis_time);
+			fresh.tables[make_pair(analysis_time, row[1])] = row[0];
+		}
+
+		if (!row[9].empty() && !row[10].empty())
+		{
+			fresh.index.Insert(stoll(row[9]), stoll(row[10]), row[0]);
+		}
+
+		fresh.rows[row[0]] = move(row);
+	}
+
+	fresh.refreshed = time(nullptr);
+
+	availability = move(fresh);
 
-	return ret;
+	FMIDEBUG(cout << "DEBUG: Grid availability for producer " << producer_id << ": " << availability.rows.size()
+	              << " rows" << endl);
 }
 
-std::string NFmiRadonDB::GetProducerMetaData(long producer_id, const string& attribute)
+/*
+ * Availability()
+ *
+ * Availability index of a producer if it covers the given analysis time,
+ * refreshing it first if it is due. Times after the newest analysis time
+ * in the index are not answered from it, as they may not have been read yet.
+ */
+
+NFmiRadonDB::GridAvailability* NFmiRadonDB::Availability(long producer_id, const string& analtime)
 {
-	string key = to_string(producer_id) + "_" + attribute;
+	auto it = gridavailability.find(producer_id);
 
-	if (producermetadatainfo.find(key) != producermetadatainfo.end())
+	if (it == gridavailability.end())
 	{
-		FMIDEBUG(cout << "DEBUG: GetProducerMetaData() cache hit!" << endl);
-
-		return producermetadatainfo[key];
+		return nullptr;
 	}
 
-	string query = "SELECT value FROM producer_meta WHERE producer_id = " + to_string(producer_id) +
-	               " AND attribute = '" + attribute + "'";
+	const time_t t = AvailabilityTime(analtime);
+	GridAvailability& availability = it->second;
 
-	Query(query);
+	if (t < availability.start || t > availability.end || t == -1)
+	{
+		return nullptr;
+	}
 
-	auto row = FetchRow();
+	if (time(nullptr) - availability.refreshed >= itsAvailabilityRefresh)
+	{
+		ReadGridAvailability(producer_id, availability);
+	}
 
-	if (row.empty())
+	if (t > availability.newest)
 	{
-		return "";
+		return nullptr;
 	}
 
-	producermetadatainfo[key] = row[0];
-	return row[0];
+	return &availability;
 }
 
-map<string, string> NFmiRadonDB::GetTableName(long producerId, const string& analysisTime, const string& geomName)
+/*
+ * AvailabilityTime()
+ *
+ * Analysis time given as 'YYYY-MM-DD HH:MI:SS' or with the separators left
+ * out, as seconds since epoch (UTC). Returns -1 if the time cannot be parsed.
+ */
+
+time_t NFmiRadonDB::AvailabilityTime(const string& theTime)
 {
-	const string key = to_string(producerId) + "_" + analysisTime + "_" + geomName;
+	string digits;
 
-	if (tablenameinfo.find(key) != tablenameinfo.end())
+	for (char c : theTime)
 	{
-		FMIDEBUG(cout << "DEBUG: GetTableName() cache hit!" << endl);
-		return tablenameinfo[key];
+		if (isdigit(static_cast<unsigned char>(c)))
+		{
+			digits += c;
+		}
 	}
 
-	stringstream ss;
-
-	ss << "SELECT "
-	   << "id, schema_name, table_name, partition_name, record_count, delete_time "
-	   << "FROM as_grid_v "
-	   << "WHERE geometry_name = '" << geomName << "'"
-	   << " AND analysis_time = to_timestamp('" << analysisTime << "', 'YYYY-MM-DD HH24:MI:SS')"
-	   << " AND producer_id = " << producerId;
-
-	Query(ss.str());
-
-	const auto row = FetchRow();
-
-	map<string, string> ret;
-
-	if (row.empty())
+	if (digits.size() < 10 || digits.size() > 14)
 	{
-		return ret;
+		return -1;
 	}
 
-	ret["id"] = row[0];
-	ret["schema_name"] = row[1];
-	ret["table_name"] = row[2];
-	ret["partition_name"] = row[3];
-	ret["record_count"] = row[4];
-	ret["delete_time"] = row[5];
+	digits.resize(14, '0');
 
-	tablenameinfo[key] = ret;
-	return ret;
+	tm t = {};
+
+	t.tm_year = stoi(digits.substr(0, 4)) - 1900;
+	t.tm_mon = stoi(digits.substr(4, 2)) - 1;
+	t.tm_mday = stoi(digits.substr(6, 2));
+	t.tm_hour = stoi(digits.substr(8, 2));
+	t.tm_min = stoi(digits.substr(10, 2));
+	t.tm_sec = stoi(digits.substr(12, 2));
+
+	return timegm(&t);
 }
 
 double NFmiRadonDB::GetProbabilityLimitForStation(long stationId, const std::string& paramName)
@@ -1822,6 +3579,9 @@ double NFmiRadonDB::GetProbabilityLimitForStation(long stationId, const std::str
 
 NFmiRadonDBPool* NFmiRadonDBPool::itsInstance = NULL;
 
+// How long an endpoint that failed to connect is skipped, if there are other endpoints available
+const time_t kEndpointRetryInterval = 30;
+
 NFmiRadonDBPool* NFmiRadonDBPool::Instance()
 {
 	if (!itsInstance)
@@ -1834,8 +3594,13 @@ NFmiRadonDBPool* NFmiRadonDBPool::Instance()
 
 NFmiRadonDBPool::NFmiRadonDBPool()
     : itsMaxWorkers(2),
+      itsReservedWorkers(0),
+      itsHighPriorityWaiting(0),
+      itsStickyLeases(false),
       itsWorkingList(itsMaxWorkers, -1),
       itsWorkerList(itsMaxWorkers, NULL),
+      itsWorkerEndpoint(itsMaxWorkers, 0),
+      itsLeaseTime(itsMaxWorkers),
       itsUsername(""),
       itsPassword(""),
       itsDatabase(""),
@@ -1846,6 +3611,8 @@ NFmiRadonDBPool::NFmiRadonDBPool()
 
 NFmiRadonDBPool::~NFmiRadonDBPool()
 {
+	FMIDEBUG(cout << "DEBUG: NFmiRadonDBPool statistics:\n" << Statistics().ToString());
+
 	for (unsigned int i = 0; i < itsWorkerList.size(); i++)
 	{
 		if (itsWorkerList[i])
@@ -1857,6 +3624,212 @@ NFmiRadonDBPool::~NFmiRadonDBPool()
 
 	delete itsInstance;
 }
+
+void NFmiRadonDBPool::AddEndpoint(const std::string& theHostname, int thePort, int theWeight)
+{
+	if (theHostname.empty())
+	{
+		throw std::runtime_error("NFmiRadonDBPool: empty endpoint hostname");
+	}
+
+	if (theWeight < 1)
+	{
+		throw std::runtime_error("NFmiRadonDBPool: endpoint weight must be positive");
+	}
+
+	lock_guard<mutex> lock(itsGetMutex);
+
+	itsEndpoints.push_back(Endpoint{theHostname, thePort, theWeight, 0, 0});
+}
+
+bool NFmiRadonDBPool::EndpointAvailable(size_t theEndpoint) const
+{
+	const auto& ep = itsEndpoints[theEndpoint];
+	return ep.failed == 0 || time(nullptr) - ep.failed >= kEndpointRetryInterval;
+}
+
+double NFmiRadonDBPool::EndpointLoad(size_t theEndpoint) const
+{
+	const auto& ep = itsEndpoints[theEndpoint];
+	return static_cast<double>(ep.leases + 1) / ep.weight;
+}
+
+/*
+ * CreateWorker()
+ *
+ * Opens a new connection for the given worker slot. Endpoints are tried
+ * in order of availability and load, so that a failed server is skipped
+ * as long as there is another one to connect to.
+ */
+
+void NFmiRadonDBPool::CreateWorker(size_t theWorker)
+{
+	if (itsUsername.empty())
+	{
+		throw std::runtime_error("NFmiRadonDBPool: empty username");
+	}
+
+	if (itsPassword.empty())
+	{
+		throw std::runtime_error("NFmiRadonDBPool: empty password");
+	}
+
+	if (itsDatabase.empty())
+	{
+		throw std::runtime_error("NFmiRadonDBPool: empty database name");
+	}
+
+	if (itsEndpoints.empty())
+	{
+		if (itsHostname.empty())
+		{
+			throw std::runtime_error("NFmiRadonDBPool: empty hostname");
+		}
+
+		itsEndpoints.push_back(Endpoint{itsHostname, itsPort, 1, 0, 0});
+	}
+
+	vector<size_t> order(itsEndpoints.size());
+	iota(order.begin(), order.end(), 0);
+
+	stable_sort(order.begin(), order.end(),
+	            [&](size_t a, size_t b)
+	            {
+		            const bool availA = EndpointAvailable(a), availB = EndpointAvailable(b);
+
+		            if (availA != availB)
+			            return availA;
+		            if (!availA)
+			            return itsEndpoints[a].failed < itsEndpoints[b].failed;
+
+		            return EndpointLoad(a) < EndpointLoad(b);
+	            });
+
+	string error;
+
+	for (const auto ep : order)
+	{
+		auto& endpoint = itsEndpoints[ep];
+		unique_ptr<NFmiRadonDB> worker(new NFmiRadonDB(static_cast<short>(theWorker)));
+
+		const auto start = chrono::steady_clock::now();
+
+		try
+		{
+			worker->Connect(itsUsername, itsPassword, itsDatabase, endpoint.hostname, endpoint.port);
+		}
+		catch (const std::exception& e)
+		{
+			endpoint.failed = time(nullptr);
+			error = e.what();
+
+			FMIDEBUG(cout << "DEBUG: Unable to connect to " << endpoint.hostname << ":" << endpoint.port << ": "
+			              << error << endl);
+			continue;
+		}
+
+		endpoint.failed = 0;
+
+		{
+			lock_guard<mutex> lock(itsStatisticsMutex);
+			itsStatistics.connectTime.Add(chrono::steady_clock::now() - start);
+		}
+
+		itsWorkerList[theWorker] = worker.release();
+		itsWorkerEndpoint[theWorker] = ep;
+		itsWorkingList[theWorker] = 0;
+
+		return;
+	}
+
+	throw std::runtime_error("NFmiRadonDBPool: unable to connect to any endpoint: " + error);
+}
+
+/*
+ * Admissible()
+ *
+ * Checks if a caller of given priority may lease a worker now. Normal
+ * priority callers are held back while high priority callers are waiting,
+ * and may not lease the reserved workers.
+ */
+
+bool NFmiRadonDBPool::Admissible(FmiDBPoolPriority thePriority) const
+{
+	if (thePriority == kHighPriority)
+	{
+		return true;
+	}
+
+	if (itsHighPriorityWaiting > 0)
+	{
+		return false;
+	}
+
+	const int leased = static_cast<int>(count(itsWorkingList.begin(), itsWorkingList.end(), 1));
+
+	return leased < itsMaxWorkers - itsReservedWorkers;
+}
+
+NFmiRadonDB* NFmiRadonDBPool::Lease(size_t theWorker, FmiDBPoolPriority thePriority,
+                                    const chrono::steady_clock::time_point& theStart, bool theWaited)
+{
+	itsWorkingList[theWorker] = 1;
+	itsEndpoints[itsWorkerEndpoint[theWorker]].leases++;
+	itsLeaseTime[theWorker] = chrono::steady_clock::now();
+
+	bool sticky = false;
+
+	if (itsStickyLeases)
+	{
+		// Entries of threads that have exited are never removed individually;
+		// forget them all if the map grows well beyond the pool size
+
+		if (itsLastWorker.size() > 16 * itsWorkerList.size())
+		{
+			itsLastWorker.clear();
+		}
+
+		// A thread's first lease is not a sticky hit, whichever worker it gets
+
+		const auto it = itsLastWorker.find(this_thread::get_id());
+
+		if (it != itsLastWorker.end())
+		{
+			sticky = (it->second == theWorker);
+			it->second = theWorker;
+		}
+		else
+		{
+			itsLastWorker.emplace(this_thread::get_id(), theWorker);
+		}
+	}
+
+	lock_guard<mutex> lock(itsStatisticsMutex);
+
+	itsStatistics.waitTime.Add(itsLeaseTime[theWorker] - theStart);
+
+	if (thePriority == kHighPriority)
+	{
+		itsStatistics.priorityWaitTime.Add(itsLeaseTime[theWorker] - theStart);
+	}
+
+	itsStatistics.leases++;
+	itsStatistics.current++;
+	itsStatistics.peak = max(itsStatistics.peak, itsStatistics.current);
+
+	if (theWaited)
+	{
+		itsStatistics.exhausted++;
+	}
+
+	if (sticky)
+	{
+		itsStatistics.sticky++;
+	}
+
+	return itsWorkerList[theWorker];
+}
+
 /*
  * GetConnection()
  *
@@ -1867,7 +3840,7 @@ NFmiRadonDBPool::~NFmiRadonDBPool()
  *
  */
 
-NFmiRadonDB* NFmiRadonDBPool::GetConnection()
+NFmiRadonDB* NFmiRadonDBPool::GetConnection(FmiDBPoolPriority thePriority)
 {
 	/*
 	 *  1 --> active
@@ -1876,65 +3849,111 @@ NFmiRadonDB* NFmiRadonDBPool::GetConnection()
 	 *
 	 * Logic of returning connections:
 	 *
-	 * 1. Check if worker is idle, if so return that worker.
+	 * 0. If sticky leases are enabled and the worker this thread used last is
+	 *    idle and its endpoint is available, return that.
+	 * 1. Check if there are idle workers on an available endpoint, if so return
+	 *    the one whose endpoint has least outstanding leases relative to its weight.
 	 * 2. Check if worker is uninitialized, if so create worker and return that.
-	 * 3. Sleep and start over
+	 * 3. Return any idle worker, even if its endpoint has recently failed.
+	 * 4. Wait for release and start over
+	 *
+	 * Normal priority callers skip directly to step 4 if they are not
+	 * admissible, see Admissible().
 	 */
 
-	lock_guard<mutex> lock(itsGetMutex);
+	const auto start = chrono::steady_clock::now();
+	bool waited = false;
+
+	unique_lock<mutex> lock(itsGetMutex);
 
 	while (true)
 	{
-		for (unsigned int i = 0; i < itsWorkingList.size(); i++)
+		if (!Admissible(thePriority))
 		{
-			// Return connection that has been initialized but is idle
-			if (itsWorkingList[i] == 0)
-			{
-				itsWorkingList[i] = 1;
+			FMIDEBUG(cout << "DEBUG: Normal priority caller waiting, reserved=" << itsReservedWorkers
+			              << " high priority waiting=" << itsHighPriorityWaiting << endl);
+
+			waited = true;
+			itsReleaseCondition.wait(lock);
+			continue;
+		}
+
+		if (itsStickyLeases)
+		{
+			const auto it = itsLastWorker.find(this_thread::get_id());
 
-				FMIDEBUG(cout << "DEBUG: Idle worker returned with id " << itsWorkerList[i]->Id() << endl);
+			if (it != itsLastWorker.end() && it->second < itsWorkingList.size() && itsWorkingList[it->second] == 0 &&
+			    EndpointAvailable(itsWorkerEndpoint[it->second]))
+			{
+				FMIDEBUG(cout << "DEBUG: Sticky worker returned with id " << it->second << endl);
 
-				return itsWorkerList[i];
+				return Lease(it->second, thePriority, start, waited);
 			}
-			else if (itsWorkingList[i] == -1)
+		}
+
+		int idle = -1;
+		int best = -1;
+
+		for (unsigned int i = 0; i < itsWorkingList.size(); i++)
+		{
+			if (itsWorkingList[i] != 0)
 			{
-				if (itsUsername.empty())
-				{
-					throw std::runtime_error("NFmiRadonDBPool: empty username");
-				}
+				continue;
+			}
 
-				if (itsPassword.empty())
-				{
-					throw std::runtime_error("NFmiRadonDBPool: empty password");
-				}
+			idle = i;
 
-				if (itsDatabase.empty())
-				{
-					throw std::runtime_error("NFmiRadonDBPool: empty database name");
-				}
+			const size_t ep = itsWorkerEndpoint[i];
+
+			if (EndpointAvailable(ep) && (best == -1 || EndpointLoad(ep) < EndpointLoad(itsWorkerEndpoint[best])))
+			{
+				best = i;
+			}
+		}
 
-				if (itsHostname.empty())
-				{
-					throw std::runtime_error("NFmiRadonDBPool: empty hostname");
-				}
+		if (best != -1)
+		{
+			FMIDEBUG(cout << "DEBUG: Idle worker returned with id " << itsWorkerList[best]->Id() << endl);
 
-				// Create new connection
-				itsWorkerList[i] = new NFmiRadonDB(static_cast<short>(i));
-				itsWorkerList[i]->Connect(itsUsername, itsPassword, itsDatabase, itsHostname, itsPort);
+			return Lease(best, thePriority, start, waited);
+		}
 
-				itsWorkingList[i] = 1;
+		for (unsigned int i = 0; i < itsWorkingList.size(); i++)
+		{
+			if (itsWorkingList[i] == -1)
+			{
+				CreateWorker(i);
 
-				FMIDEBUG(cout << "DEBUG: New worker returned with id " << itsWorkerList[i]->Id() << endl);
+				FMIDEBUG(cout << "DEBUG: New worker returned with id " << itsWorkerList[i]->Id() << " connected to "
+				              << itsEndpoints[itsWorkerEndpoint[i]].hostname << endl);
 
-				return itsWorkerList[i];
+				return Lease(i, thePriority, start, waited);
 			}
 		}
 
+		if (idle != -1)
+		{
+			FMIDEBUG(cout << "DEBUG: Idle worker returned with id " << itsWorkerList[idle]->Id() << endl);
+
+			return Lease(idle, thePriority, start, waited);
+		}
+
 		// All threads active
 		FMIDEBUG(cout << "DEBUG: Waiting for worker release. Pool size=" << itsWorkerList.size() << endl);
 		assert(itsWorkerList.size() == itsWorkingList.size());
 
-		usleep(100000);  // 100 ms
+		waited = true;
+
+		if (thePriority == kHighPriority)
+		{
+			itsHighPriorityWaiting++;
+			itsReleaseCondition.wait(lock);
+			itsHighPriorityWaiting--;
+		}
+		else
+		{
+			itsReleaseCondition.wait(lock);
+		}
 	}
 }
 
@@ -1942,19 +3961,79 @@ NFmiRadonDB* NFmiRadonDBPool::GetConnection()
  * Release()
  *
  * Clears the database connection (does not disconnect!) and returns it
- * to pool.
+ * to pool. If the connection has been lost, the worker is removed and its
+ * endpoint is marked failed so that a replacement is opened elsewhere.
  */
 
 void NFmiRadonDBPool::Release(NFmiRadonDB* theWorker)
 {
-	theWorker->Rollback();
-	itsWorkingList[theWorker->Id()] = 0;
+	bool broken = false;
+
+	try
+	{
+		theWorker->Rollback();
+		broken = !theWorker->db_->is_open();
+	}
+	catch (const std::exception& e)
+	{
+		broken = true;
+	}
+
+	const short id = theWorker->Id();
+
+	// Lease times are written by Lease() and resized by MaxWorkers() under itsGetMutex
+
+	chrono::steady_clock::duration holdTime;
+
+	{
+		lock_guard<mutex> lock(itsGetMutex);
+
+		holdTime = chrono::steady_clock::now() - itsLeaseTime[id];
+
+		auto& endpoint = itsEndpoints[itsWorkerEndpoint[id]];
+		endpoint.leases--;
+
+		if (broken)
+		{
+			FMIDEBUG(cout << "DEBUG: Connection to " << endpoint.hostname << " lost, removing worker with id " << id
+			              << endl);
+
+			endpoint.failed = time(nullptr);
+
+			delete theWorker;
+			itsWorkerList[id] = NULL;
+			itsWorkingList[id] = -1;
+		}
+		else
+		{
+			itsWorkingList[id] = 0;
+		}
+	}
+
+	{
+		lock_guard<mutex> lock(itsStatisticsMutex);
+
+		itsStatistics.holdTime.Add(holdTime);
+		itsStatistics.current--;
+
+		if (broken)
+		{
+			itsStatistics.reconnects++;
+		}
+	}
+
+	// Waiters of different priority wait on the same condition, wake them all
+	// so that the one who is admissible gets the worker
 
-	FMIDEBUG(cout << "DEBUG: Worker released for id " << theWorker->Id() << endl);
+	itsReleaseCondition.notify_all();
+
+	FMIDEBUG(cout << "DEBUG: Worker released for id " << id << endl);
 }
 
 void NFmiRadonDBPool::MaxWorkers(int theMaxWorkers)
 {
+	lock_guard<mutex> lock(itsGetMutex);
+
 	if (theMaxWorkers == itsMaxWorkers)
 		return;
 
@@ -1968,4 +4047,41 @@ void NFmiRadonDBPool::MaxWorkers(int theMaxWorkers)
 
 	itsWorkingList.resize(itsMaxWorkers, -1);
 	itsWorkerList.resize(itsMaxWorkers, NULL);
+	itsWorkerEndpoint.resize(itsMaxWorkers, 0);
+	itsLeaseTime.resize(itsMaxWorkers);
+
+	itsReleaseCondition.notify_all();
+}
+
+void NFmiRadonDBPool::ReservedWorkers(int theReservedWorkers)
+{
+	lock_guard<mutex> lock(itsGetMutex);
+
+	if (theReservedWorkers < 0 || theReservedWorkers >= itsMaxWorkers)
+		throw runtime_error("Number of reserved workers must be between 0 and " + to_string(itsMaxWorkers - 1));
+
+	itsReservedWorkers = theReservedWorkers;
+
+	itsReleaseCondition.notify_all();
+}
+
+NFmiDBPoolStatistics NFmiRadonDBPool::Statistics()
+{
+	lock_guard<mutex> lock(itsStatisticsMutex);
+
+	NFmiDBPoolStatistics ret = itsStatistics;
+	ret.maxWorkers = itsMaxWorkers;
+
+	return ret;
+}
+
+void NFmiRadonDBPool::ResetStatistics()
+{
+	lock_guard<mutex> lock(itsStatisticsMutex);
+
+	const int current = itsStatistics.current;
+
+	itsStatistics = NFmiDBPoolStatistics();
+	itsStatistics.current = current;
+	itsStatistics.peak = current;
 }
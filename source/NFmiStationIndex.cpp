@@ -0,0 +1,291 @@
+#include "NFmiStationIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+const double kEarthRadius = 6371.0;  // km
+const double kDegToRad = M_PI / 180.0;
+
+void ToXyz(double theLatitude, double theLongitude, double* theXyz)
+{
+	const double lat = theLatitude * kDegToRad;
+	const double lon = theLongitude * kDegToRad;
+
+	theXyz[0] = cos(lat) * cos(lon);
+	theXyz[1] = cos(lat) * sin(lon);
+	theXyz[2] = sin(lat);
+}
+
+double SquaredChord(const double* a, const double* b)
+{
+	const double dx = a[0] - b[0];
+	const double dy = a[1] - b[1];
+	const double dz = a[2] - b[2];
+
+	return dx * dx + dy * dy + dz * dz;
+}
+}  // namespace
+
+NFmiStationIndex::NFmiStationIndex(double theCellSize)
+    : itsCellSize(theCellSize), itsSize(0), itsTreeMutex(new mutex), itsTreeBuilt(false)
+{
+	Clear();
+}
+
+void NFmiStationIndex::Clear()
+{
+	itsCells.clear();
+	itsSize = 0;
+	itsTree.clear();
+	itsTreeAxis.clear();
+	itsTreeBuilt = false;
+	itsMinLatCell = numeric_limits<long>::max();
+	itsMaxLatCell = numeric_limits<long>::min();
+	itsMinLonCell = numeric_limits<long>::max();
+	itsMaxLonCell = numeric_limits<long>::min();
+}
+
+long NFmiStationIndex::Cell(double theCoordinate) const
+{
+	return static_cast<long>(floor(theCoordinate / itsCellSize));
+}
+
+void NFmiStationIndex::Insert(size_t theId, double theLatitude, double theLongitude)
+{
+	const long latCell = Cell(theLatitude);
+	const long lonCell = Cell(theLongitude);
+
+	itsCells[make_pair(latCell, lonCell)].push_back(Point{theId, theLatitude, theLongitude});
+	itsSize++;
+
+	TreePoint point;
+	point.id = theId;
+	ToXyz(theLatitude, theLongitude, point.xyz);
+
+	itsTree.push_back(point);
+	itsTreeBuilt = false;
+
+	itsMinLatCell = min(itsMinLatCell, latCell);
+	itsMaxLatCell = max(itsMaxLatCell, latCell);
+	itsMinLonCell = min(itsMinLonCell, lonCell);
+	itsMaxLonCell = max(itsMaxLonCell, lonCell);
+}
+
+/*
+ * Find()
+ *
+ * Visits the cells overlapping the box (clamped to the cells in use) and
+ * checks the exact coordinates of the stations in them.
+ */
+
+vector<size_t> NFmiStationIndex::Find(double theMinLatitude, double theMaxLatitude, double theMinLongitude,
+                                      double theMaxLongitude) const
+{
+	vector<size_t> ret;
+
+	if (itsSize == 0 || theMinLatitude > theMaxLatitude || theMinLongitude > theMaxLongitude)
+	{
+		return ret;
+	}
+
+	const long minLatCell = max(itsMinLatCell, Cell(max(theMinLatitude, -1e6)));
+	const long maxLatCell = min(itsMaxLatCell, Cell(min(theMaxLatitude, 1e6)));
+	const long minLonCell = max(itsMinLonCell, Cell(max(theMinLongitude, -1e6)));
+	const long maxLonCell = min(itsMaxLonCell, Cell(min(theMaxLongitude, 1e6)));
+
+	for (long latCell = minLatCell; latCell <= maxLatCell; latCell++)
+	{
+		// Cells of one latitude band are adjacent in the map
+
+		auto it = itsCells.lower_bound(make_pair(latCell, minLonCell));
+		const auto end = itsCells.upper_bound(make_pair(latCell, maxLonCell));
+
+		for (; it != end; ++it)
+		{
+			for (const auto& point : it->second)
+			{
+				if (point.latitude >= theMinLatitude && point.latitude <= theMaxLatitude &&
+				    point.longitude >= theMinLongitude && point.longitude <= theMaxLongitude)
+				{
+					ret.push_back(point.id);
+				}
+			}
+		}
+	}
+
+	sort(ret.begin(), ret.end());
+
+	return ret;
+}
+
+/*
+ * Nearest()
+ *
+ * Chord length between points on the unit sphere grows with great circle
+ * distance, so the nearest stations by chord are the nearest by distance.
+ */
+
+vector<pair<size_t, double>> NFmiStationIndex::Nearest(double theLatitude, double theLongitude, size_t theCount,
+                                                       double theMaxDistance) const
+{
+	vector<pair<size_t, double>> ret;
+
+	if (theCount == 0 || itsSize == 0)
+	{
+		return ret;
+	}
+
+	BuildTree();
+
+	double xyz[3];
+	ToXyz(theLatitude, theLongitude, xyz);
+
+	// Search radius as squared chord, shrinks to the k'th nearest once k are found
+
+	double limit = 4.0 + 1e-9;
+
+	if (theMaxDistance > 0 && theMaxDistance < M_PI * kEarthRadius)
+	{
+		const double chord = 2 * sin(theMaxDistance / (2 * kEarthRadius));
+		limit = chord * chord;
+	}
+
+	vector<pair<double, size_t>> heap;  // max-heap of (squared chord, tree position)
+	heap.reserve(theCount + 1);
+
+	SearchTree(0, itsTree.size(), xyz, theCount, heap, limit);
+
+	sort_heap(heap.begin(), heap.end());
+
+	ret.reserve(heap.size());
+
+	for (const auto& item : heap)
+	{
+		const double chord = sqrt(item.first);
+		ret.push_back(make_pair(itsTree[item.second].id, 2 * kEarthRadius * asin(min(1.0, chord / 2))));
+	}
+
+	return ret;
+}
+
+void NFmiStationIndex::BuildTree() const
+{
+	lock_guard<mutex> lock(*itsTreeMutex);
+
+	if (itsTreeBuilt)
+	{
+		return;
+	}
+
+	itsTreeAxis.assign(itsTree.size(), 0);
+	BuildTree(0, itsTree.size());
+
+	itsTreeBuilt = true;
+}
+
+void NFmiStationIndex::BuildTree(size_t theBegin, size_t theEnd) const
+{
+	if (theEnd - theBegin < 2)
+	{
+		return;
+	}
+
+	// Split along the axis with the largest extent
+
+	double lo[3] = {2, 2, 2};
+	double hi[3] = {-2, -2, -2};
+
+	for (size_t i = theBegin; i < theEnd; i++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			lo[a] = min(lo[a], itsTree[i].xyz[a]);
+			hi[a] = max(hi[a], itsTree[i].xyz[a]);
+		}
+	}
+
+	int axis = 0;
+
+	for (int a = 1; a < 3; a++)
+	{
+		if (hi[a] - lo[a] > hi[axis] - lo[axis])
+		{
+			axis = a;
+		}
+	}
+
+	const size_t mid = theBegin + (theEnd - theBegin) / 2;
+
+	nth_element(itsTree.begin() + theBegin, itsTree.begin() + mid, itsTree.begin() + theEnd,
+	            [axis](const TreePoint& a, const TreePoint& b) { return a.xyz[axis] < b.xyz[axis]; });
+
+	itsTreeAxis[mid] = static_cast<unsigned char>(axis);
+
+	BuildTree(theBegin, mid);
+	BuildTree(mid + 1, theEnd);
+}
+
+void NFmiStationIndex::SearchTree(size_t theBegin, size_t theEnd, const double* theXyz, size_t theCount,
+                                  vector<pair<double, size_t>>& theHeap, double& theLimit) const
+{
+	if (theBegin >= theEnd)
+	{
+		return;
+	}
+
+	const size_t mid = theBegin + (theEnd - theBegin) / 2;
+	const TreePoint& node = itsTree[mid];
+
+	const double d = SquaredChord(theXyz, node.xyz);
+
+	if (d <= theLimit)
+	{
+		theHeap.push_back(make_pair(d, mid));
+		push_heap(theHeap.begin(), theHeap.end());
+
+		if (theHeap.size() > theCount)
+		{
+			pop_heap(theHeap.begin(), theHeap.end());
+			theHeap.pop_back();
+		}
+
+		if (theHeap.size() == theCount)
+		{
+			theLimit = min(theLimit, theHeap.front().first);
+		}
+	}
+
+	if (theEnd - theBegin == 1)
+	{
+		return;
+	}
+
+	const int axis = itsTreeAxis[mid];
+	const double diff = theXyz[axis] - node.xyz[axis];
+
+	// Nearer side first, the other side only if it can contain closer points
+
+	if (diff < 0)
+	{
+		SearchTree(theBegin, mid, theXyz, theCount, theHeap, theLimit);
+
+		if (diff * diff <= theLimit)
+		{
+			SearchTree(mid + 1, theEnd, theXyz, theCount, theHeap, theLimit);
+		}
+	}
+	else
+	{
+		SearchTree(mid + 1, theEnd, theXyz, theCount, theHeap, theLimit);
+
+		if (diff * diff <= theLimit)
+		{
+			SearchTree(theBegin, mid, theXyz, theCount, theHeap, theLimit);
+		}
+	}
+}